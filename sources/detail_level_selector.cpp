@@ -0,0 +1,280 @@
+#include "detail_level_selector.h"
+
+#include <algorithm>
+#include <float.h>
+
+using namespace smlt;
+
+namespace detail_level_selector
+{
+
+namespace
+{
+
+DetailLevel level_for_size(float size, const Thresholds &thresholds, float scale)
+{
+    for (int level = DETAIL_LEVEL_NEAREST; level < DETAIL_LEVEL_MAX - 1; ++level)
+    {
+        if (size >= thresholds.pixels[level] * scale)
+        {
+            return DetailLevel(level);
+        }
+    }
+
+    return DETAIL_LEVEL_FARTHEST;
+}
+
+} // namespace
+
+float projected_size(const AABB &bounds, const Vec3 &eye, const Mat4 &projection, float viewport_height)
+{
+    float radius = (bounds.max() - bounds.min()).length() * 0.5f;
+
+    /* projection[5] is cot(fov / 2) for a perspective projection, and
+     * 2 / height for an orthographic one, where size doesn't change with
+     * distance */
+    if (projection[11] == 0.0f)
+    {
+        return radius * projection[5] * viewport_height;
+    }
+
+    float distance = (bounds.centre() - eye).length();
+    if (distance <= radius)
+    {
+        return FLT_MAX;
+    }
+
+    return radius * projection[5] * viewport_height / distance;
+}
+
+DetailLevel select_detail_level(float projected_size, DetailLevel current, const Thresholds &thresholds)
+{
+    DetailLevel finer = level_for_size(projected_size, thresholds, 1.0f + thresholds.hysteresis);
+    if (finer < current)
+    {
+        return finer;
+    }
+
+    DetailLevel coarser = level_for_size(projected_size, thresholds, 1.0f - thresholds.hysteresis);
+    if (coarser > current)
+    {
+        return coarser;
+    }
+
+    return current;
+}
+
+uint32_t triangle_count(MeshPtr mesh)
+{
+    uint32_t triangles = 0;
+    for (auto &submesh : mesh->each_submesh())
+    {
+        if (submesh->type() != SUBMESH_TYPE_INDEXED)
+        {
+            continue;
+        }
+
+        uint32_t count = submesh->index_data->count();
+        switch (submesh->arrangement())
+        {
+        case MESH_ARRANGEMENT_TRIANGLES:
+            triangles += count / 3;
+            break;
+        case MESH_ARRANGEMENT_TRIANGLE_STRIP:
+        case MESH_ARRANGEMENT_TRIANGLE_FAN:
+            triangles += (count > 2) ? count - 2 : 0;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return triangles;
+}
+
+DetailLevel Selector::Entry::level() const
+{
+    return DetailLevel(std::min<uint32_t>(screen_level + demotion, DETAIL_LEVEL_FARTHEST));
+}
+
+Selector::~Selector()
+{
+    for (auto &entry : entries_)
+    {
+        entry.destroyed.disconnect();
+    }
+}
+
+void Selector::add(ActorPtr actor, const std::array<MeshPtr, DETAIL_LEVEL_MAX> &meshes)
+{
+    Entry entry;
+    entry.actor = actor;
+    entry.meshes = meshes;
+
+    if (!entry.meshes[DETAIL_LEVEL_NEAREST])
+    {
+        entry.meshes[DETAIL_LEVEL_NEAREST] = actor->base_mesh();
+    }
+
+    for (int level = DETAIL_LEVEL_NEAREST; level < DETAIL_LEVEL_MAX; ++level)
+    {
+        if (level > DETAIL_LEVEL_NEAREST && !entry.meshes[level])
+        {
+            entry.meshes[level] = entry.meshes[level - 1];
+        }
+
+        entry.triangles[level] = triangle_count(entry.meshes[level]);
+    }
+
+    actor->set_mesh(entry.meshes[DETAIL_LEVEL_NEAREST]->id(), DETAIL_LEVEL_NEAREST);
+    entry.destroyed = actor->signal_destroyed().connect([this, actor]() { remove(actor); });
+    entries_.push_back(entry);
+}
+
+void Selector::remove(ActorPtr actor)
+{
+    for (auto &entry : entries_)
+    {
+        if (entry.actor == actor)
+        {
+            entry.destroyed.disconnect();
+        }
+    }
+
+    entries_.erase(
+        std::remove_if(entries_.begin(), entries_.end(), [actor](const Entry &entry) { return entry.actor == actor; }),
+        entries_.end());
+}
+
+void Selector::update(CameraPtr camera, float viewport_height, uint32_t polygons_rendered)
+{
+    Vec3 eye = camera->absolute_position();
+    const Mat4 &projection = camera->projection_matrix();
+
+    for (auto &entry : entries_)
+    {
+        auto bounds = entry.actor->transformed_aabb();
+        entry.distance = (bounds.centre() - eye).length();
+        entry.visible = !camera->frustum().initialized() || camera->frustum().intersects_aabb(bounds);
+
+        float size = projected_size(bounds, eye, projection, viewport_height);
+        entry.screen_level = select_detail_level(size, entry.screen_level, thresholds_);
+        entry.demotion = std::min<uint32_t>(entry.demotion, DETAIL_LEVEL_FARTHEST - entry.screen_level);
+    }
+
+    apply_budget(polygons_rendered);
+
+    for (auto &entry : entries_)
+    {
+        DetailLevel level = entry.level();
+        if (entry.meshes[level] != entry.meshes[entry.applied])
+        {
+            entry.actor->set_mesh(entry.meshes[level]->id(), DETAIL_LEVEL_NEAREST);
+        }
+        entry.applied = level;
+        entry.drawn = entry.visible;
+    }
+}
+
+void Selector::apply_budget(uint32_t polygons_rendered)
+{
+    if (!triangle_budget_)
+    {
+        for (auto &entry : entries_)
+        {
+            entry.demotion = 0;
+        }
+        return;
+    }
+
+    /* Estimate this frame's count by swapping each actor's contribution to
+     * last frame's count for its contribution now. Actors out of view
+     * contribute nothing. */
+    int64_t predicted = polygons_rendered;
+    std::vector<Entry *> visible;
+    for (auto &entry : entries_)
+    {
+        int64_t before = entry.drawn ? entry.triangles[entry.applied] : 0;
+        int64_t after = entry.visible ? entry.triangles[entry.level()] : 0;
+        predicted += after - before;
+
+        if (entry.visible)
+        {
+            visible.push_back(&entry);
+        }
+    }
+
+    if (predicted > int64_t(triangle_budget_))
+    {
+        /* Demote whichever actor saves the most, weighted by distance, one
+         * level at a time. Savings shrink with each level, so the demotion
+         * spreads over the heavy actors before any loses several levels. */
+        while (predicted > int64_t(triangle_budget_))
+        {
+            Entry *best = nullptr;
+            int64_t best_saving = 0;
+            float best_priority = 0.0f;
+            for (auto entry : visible)
+            {
+                DetailLevel level = entry->level();
+                if (level == DETAIL_LEVEL_FARTHEST)
+                {
+                    continue;
+                }
+
+                int64_t saving = int64_t(entry->triangles[level]) - int64_t(entry->triangles[level + 1]);
+                float priority = saving * entry->distance;
+                if (saving > 0 && (!best || priority > best_priority))
+                {
+                    best = entry;
+                    best_saving = saving;
+                    best_priority = priority;
+                }
+            }
+
+            if (!best)
+            {
+                break;
+            }
+
+            best->demotion++;
+            predicted -= best_saving;
+        }
+        return;
+    }
+
+    /* Under budget, so undo demotions cheapest first while they still fit */
+    while (true)
+    {
+        Entry *best = nullptr;
+        int64_t best_cost = 0;
+        float best_priority = 0.0f;
+        for (auto entry : visible)
+        {
+            if (!entry->demotion)
+            {
+                continue;
+            }
+
+            DetailLevel level = entry->level();
+            int64_t cost = int64_t(entry->triangles[level - 1]) - int64_t(entry->triangles[level]);
+            float priority = cost * entry->distance;
+            if (!best || priority < best_priority)
+            {
+                best = entry;
+                best_cost = cost;
+                best_priority = priority;
+            }
+        }
+
+        if (!best || predicted + best_cost > int64_t(triangle_budget_))
+        {
+            break;
+        }
+
+        best->demotion--;
+        predicted += best_cost;
+    }
+}
+
+} // namespace detail_level_selector
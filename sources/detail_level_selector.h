@@ -0,0 +1,103 @@
+#pragma once
+
+#include "simulant/simulant.h"
+
+#include <array>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Screen-space detail level selection.
+ *
+ * The pipeline picks an actor's detail level from fixed distance cutoffs,
+ * which treat a small prop and a large vehicle alike and flicker at the
+ * boundaries. The selector instead picks a level from each actor's projected
+ * size on screen, with hysteresis around each threshold, and can demote the
+ * distant, heavy actors to keep the scene under a triangle budget.
+ *
+ * The chosen mesh is set as the actor's DETAIL_LEVEL_NEAREST mesh. Registered
+ * actors shouldn't have meshes at the other levels, so the pipeline's
+ * distance-based choice always falls back to it.
+ */
+namespace detail_level_selector
+{
+
+struct Thresholds
+{
+    /* Smallest projected height, in pixels, at which each level from
+     * DETAIL_LEVEL_NEAREST onwards is used. Anything smaller is drawn at
+     * DETAIL_LEVEL_FARTHEST. */
+    float pixels[smlt::DETAIL_LEVEL_MAX - 1] = {240.0f, 120.0f, 60.0f, 30.0f};
+
+    /* How far past a threshold, as a fraction of it, the projected size must
+     * move before the level changes */
+    float hysteresis = 0.15f;
+};
+
+/* Height in pixels of the bounding sphere of bounds, seen from eye through
+ * projection on a viewport viewport_height pixels high. Returns FLT_MAX if
+ * eye is inside the sphere. */
+float projected_size(const smlt::AABB &bounds, const smlt::Vec3 &eye, const smlt::Mat4 &projection, float viewport_height);
+
+/* The detail level for an object of projected_size pixels that is currently
+ * drawn at current */
+smlt::DetailLevel select_detail_level(float projected_size, smlt::DetailLevel current, const Thresholds &thresholds = Thresholds());
+
+/* Triangles drawn by the mesh's indexed submeshes, counting strip degenerates
+ * the same way the stats recorder does */
+uint32_t triangle_count(smlt::MeshPtr mesh);
+
+class Selector
+{
+public:
+    Selector(const Thresholds &thresholds = Thresholds()) : thresholds_(thresholds) {}
+    Selector(const Selector &) = delete;
+    Selector &operator=(const Selector &) = delete;
+    ~Selector();
+
+    /* Registers an actor with a mesh for each detail level, such as the ones
+     * from mesh_simplifier::generate_detail_levels(). Empty entries fall back
+     * to the closest more detailed mesh. The actor is removed again when it
+     * is destroyed. */
+    void add(smlt::ActorPtr actor, const std::array<smlt::MeshPtr, smlt::DETAIL_LEVEL_MAX> &meshes);
+    void remove(smlt::ActorPtr actor);
+
+    /* Triangles per frame to aim for, or 0 for no budget */
+    void set_triangle_budget(uint32_t triangles) { triangle_budget_ = triangles; }
+
+    /* Reselects every actor's level. polygons_rendered is the previous frame's
+     * count from the stats recorder; when it is over budget actors are
+     * demoted one level at a time until the estimated saving covers the
+     * excess, largest saving first, weighted by distance so the farther of
+     * two alike goes first. Demotions are undone, smallest cost first, once
+     * they fit back under the budget. Actors outside the camera's frustum
+     * aren't counted, and keep their demotion until they are back in view. */
+    void update(smlt::CameraPtr camera, float viewport_height, uint32_t polygons_rendered);
+
+private:
+    struct Entry
+    {
+        smlt::ActorPtr actor = nullptr;
+        std::array<smlt::MeshPtr, smlt::DETAIL_LEVEL_MAX> meshes;
+        std::array<uint32_t, smlt::DETAIL_LEVEL_MAX> triangles;
+
+        smlt::DetailLevel screen_level = smlt::DETAIL_LEVEL_NEAREST;
+        uint32_t demotion = 0; // Extra levels dropped to meet the budget
+        smlt::DetailLevel applied = smlt::DETAIL_LEVEL_NEAREST;
+        float distance = 0.0f;
+        bool visible = true;
+        bool drawn = true; // Counted in the last polygons_rendered
+
+        smlt::sig::connection destroyed;
+
+        smlt::DetailLevel level() const;
+    };
+
+    Thresholds thresholds_;
+    uint32_t triangle_budget_ = 0;
+    std::vector<Entry> entries_;
+
+    void apply_budget(uint32_t polygons_rendered);
+};
+
+} // namespace detail_level_selector
@@ -4,7 +4,13 @@
 #include "simulant/macros.h"
 #include "simulant/utils/dreamcast.h"
 
+#include "detail_level_selector.h"
+#include "mesh_optimiser.h"
+#include "mesh_simplifier.h"
+#include "texture_streamer.h"
+
 #include <math.h>
+#include <memory>
 #include <vector>
 #include <string.h>
 
@@ -35,6 +41,16 @@ public:
     int ticker = 0;
     int side = 0;
 
+    /* Player motion gathered over this frame's fixed steps. It's applied once
+     * in update() so the partitioner sees a single staged write per frame,
+     * rather than one per fixed step. */
+    Vec3 player_motion;
+
+    /* Picks each actor's detail level from its size on screen */
+    detail_level_selector::Selector detail_levels;
+
+    std::unique_ptr<texture_streamer::Streamer> textures;
+
     void load()
     {
         stage_ = new_stage(PARTITIONER_NULL);
@@ -52,13 +68,54 @@ public:
 
         stage_->set_ambient_light(Colour(0.25f, 0.25f, 0.25f, 1.0f));
 
-        txt_grass = stage_->assets->new_texture_from_file("sample_data/grass3.png");
+        /* Textures decode on a worker thread and show a checkerboard until
+         * they're uploaded. Their larger mipmap levels only go to video
+         * memory once they're big enough on screen to need them. */
+        texture_streamer::Config texture_config;
+        texture_config.upload_budget = 128 * 1024;
+        texture_config.stream_levels = true;
+        texture_config.mipmaps.wrap = true;
+        textures.reset(new texture_streamer::Streamer(stage_->assets.get(), window->renderer.get(), app->vfs.get(), texture_config));
+
+        txt_grass = textures->load("sample_data/grass3.png");
+        if (!txt_grass)
+        {
+            /* The streamer couldn't find it, so load it the usual way */
+            txt_grass = stage_->assets->new_texture_from_file("sample_data/grass3.png");
+        }
         txt_grass->set_texture_filter(TEXTURE_FILTER_BILINEAR);
         mat_grass = stage_->assets->new_material_from_texture(txt_grass);
         mat_grass->pass(0)->set_lighting_enabled(true);
 
         auto cube = stage_->assets->new_mesh_from_file("sample_data/tank.obj");
+        auto report = mesh_optimiser::optimise_mesh(cube);
+        S_INFO("Optimised tank ({0} triangles): ACMR {1} -> {2}", report.triangles, report.acmr_before, report.acmr_after);
+
+#ifdef __DREAMCAST__
+        /* Strips are much cheaper than lists on the PowerVR */
+        bool generate_strips = true;
+#else
+        bool generate_strips = false;
+#endif
+        auto finalised = mesh_optimiser::finalise_mesh(cube, generate_strips);
+        S_INFO("Tank index data: {0} -> {1} bytes ({2} strips)", finalised.index_bytes_before, finalised.index_bytes_after, finalised.strips);
+
         player = stage_->new_actor_with_mesh(cube);
+
+        auto player_meshes = mesh_simplifier::generate_detail_levels(stage_->assets.get(), cube);
+        for (int level = DETAIL_LEVEL_NEAR; level < DETAIL_LEVEL_MAX; ++level)
+        {
+            if (player_meshes[level])
+            {
+                mesh_optimiser::finalise_mesh(player_meshes[level], generate_strips);
+            }
+        }
+        detail_levels.add(player, player_meshes);
+
+#ifdef __DREAMCAST__
+        detail_levels.set_triangle_budget(20000);
+#endif
+
         player->move_to(0.0, 3.0, 0.0);
         player->rotate_by(Degrees(15), Degrees(15), Degrees(15));
         // controller = player->new_behaviour<behaviours::RigidBody>(physics);
@@ -89,6 +146,14 @@ public:
     {
         _S_UNUSED(dt);
 
+        textures->update();
+
+        if (player_motion != Vec3())
+        {
+            player->move_by(player_motion);
+            player_motion = Vec3();
+        }
+
         /*
         // Camera Controls
         if (input->axis_value_hard("Left Trigger") != 0) //
@@ -159,6 +224,11 @@ public:
                               lerp(camera_->absolute_position().z, mz, 3.0f * dt)));
 
         camera_->look_at(Vec3(0, 3, 0));
+        detail_levels.update(camera_, window->height(), app->stats->polygons_rendered());
+
+        textures->request_size(
+            txt_grass,
+            detail_level_selector::projected_size(actor_floor->transformed_aabb(), camera_->absolute_position(), camera_->projection_matrix(), window->height()));
 
         if (input->axis_value_hard("A Button") == 1)
         {
@@ -184,7 +254,7 @@ public:
         auto horz = input->axis_value("Horizontal") * 5.0f;
         auto vert = input->axis_value("Vertical") * -5.0f;
 
-        player->move_by((camera_->up() * vert * dt * -1) + (camera_->right() * horz * dt));
+        player_motion += (camera_->up() * vert * dt * -1) + (camera_->right() * horz * dt);
 
         /*
 
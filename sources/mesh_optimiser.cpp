@@ -0,0 +1,711 @@
+#include "mesh_optimiser.h"
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <math.h>
+#include <string.h>
+
+using namespace smlt;
+
+namespace mesh_optimiser
+{
+
+namespace
+{
+
+/* Scoring constants from Tom Forsyth's "Linear-Speed Vertex Cache
+ * Optimisation" */
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+struct VertexState
+{
+    int32_t cache_position = -1;
+    uint32_t remaining = 0;      // Triangles using this vertex not yet emitted
+    uint32_t first_triangle = 0; // Offset into the adjacency list
+    float score = 0.0f;
+};
+
+float vertex_score(const VertexState &vertex)
+{
+    if (vertex.remaining == 0)
+    {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (vertex.cache_position >= 0)
+    {
+        if (vertex.cache_position < 3)
+        {
+            /* Vertices of the triangle just emitted get a fixed score, so the
+             * next pick doesn't simply strip along the same edge */
+            score = LAST_TRIANGLE_SCORE;
+        }
+        else
+        {
+            const float scaler = 1.0f / float(FORSYTH_CACHE_SIZE - 3);
+            score = powf(1.0f - float(vertex.cache_position - 3) * scaler, CACHE_DECAY_POWER);
+        }
+    }
+
+    /* Favour vertices with few triangles left so that lone triangles get
+     * picked up rather than left until the end */
+    score += VALENCE_BOOST_SCALE * powf(float(vertex.remaining), -VALENCE_BOOST_POWER);
+    return score;
+}
+
+uint32_t index_type_size(IndexType type)
+{
+    switch (type)
+    {
+    case INDEX_TYPE_8_BIT:
+        return 1;
+    case INDEX_TYPE_16_BIT:
+        return 2;
+    case INDEX_TYPE_32_BIT:
+    default:
+        return 4;
+    }
+}
+
+/* The largest index an index type can hold */
+uint32_t index_type_limit(IndexType type)
+{
+    switch (type)
+    {
+    case INDEX_TYPE_8_BIT:
+        return 0xFF;
+    case INDEX_TYPE_16_BIT:
+        return 0xFFFF;
+    case INDEX_TYPE_32_BIT:
+    default:
+        return 0xFFFFFFFF;
+    }
+}
+
+typedef std::pair<uint32_t, uint32_t> Edge;
+typedef std::multimap<Edge, uint32_t> EdgeMap;
+
+/* Finds an unused triangle containing the directed edge (a, b), marks it used
+ * and records it in taken. Returns the triangle's remaining vertex, or -1 if
+ * there isn't one. */
+int64_t take_triangle(const std::vector<uint32_t> &indices, const EdgeMap &edges, std::vector<bool> &used, std::vector<uint32_t> &taken, uint32_t a, uint32_t b)
+{
+    auto range = edges.equal_range(Edge(a, b));
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        auto t = it->second;
+        if (used[t])
+        {
+            continue;
+        }
+
+        const uint32_t *corners = &indices[t * 3];
+        for (auto c = 0u; c < 3; ++c)
+        {
+            if (corners[c] == a && corners[(c + 1) % 3] == b)
+            {
+                used[t] = true;
+                taken.push_back(t);
+                return corners[(c + 2) % 3];
+            }
+        }
+    }
+
+    return -1;
+}
+
+/* Grows a strip from triangle t starting at the given corner rotation. Every
+ * triangle the strip uses is marked used and recorded in taken, so a trial
+ * run can be undone by the caller. */
+std::vector<uint32_t> grow_strip(const std::vector<uint32_t> &indices, const EdgeMap &edges, std::vector<bool> &used, std::vector<uint32_t> &taken, uint32_t t, uint32_t rotation)
+{
+    const uint32_t *corners = &indices[t * 3];
+    std::vector<uint32_t> strip = {
+        corners[rotation],
+        corners[(rotation + 1) % 3],
+        corners[(rotation + 2) % 3]};
+    used[t] = true;
+    taken.push_back(t);
+
+    while (true)
+    {
+        /* Even triangles in a strip wind (n-2, n-1, x), odd ones (n-1, n-2, x) */
+        auto p = strip[strip.size() - 2];
+        auto q = strip[strip.size() - 1];
+        bool even = (strip.size() % 2) == 0;
+        auto next = (even) ? take_triangle(indices, edges, used, taken, p, q) : take_triangle(indices, edges, used, taken, q, p);
+        if (next < 0)
+        {
+            break;
+        }
+        strip.push_back(uint32_t(next));
+    }
+
+    return strip;
+}
+
+} // namespace
+
+float calculate_acmr(const std::vector<uint32_t> &indices, uint32_t cache_size)
+{
+    const std::size_t triangles = indices.size() / 3;
+    if (!triangles || !cache_size)
+    {
+        return 0.0f;
+    }
+
+    std::vector<uint32_t> cache(cache_size, ~0u);
+    std::size_t head = 0;
+    std::size_t misses = 0;
+
+    for (auto i = 0u; i < triangles * 3; ++i)
+    {
+        if (std::find(cache.begin(), cache.end(), indices[i]) == cache.end())
+        {
+            cache[head] = indices[i];
+            head = (head + 1) % cache_size;
+            ++misses;
+        }
+    }
+
+    return float(misses) / float(triangles);
+}
+
+void optimise_vertex_cache(std::vector<uint32_t> &indices, uint32_t vertex_count)
+{
+    const uint32_t triangle_count = indices.size() / 3;
+    if (triangle_count < 2)
+    {
+        return;
+    }
+
+    std::vector<VertexState> vertices(vertex_count);
+    for (auto i = 0u; i < triangle_count * 3; ++i)
+    {
+        vertices[indices[i]].remaining++;
+    }
+
+    /* Build a flat vertex -> triangle adjacency list. Each vertex owns
+     * [first_triangle, first_triangle + remaining) and emitted triangles are
+     * swapped out of the end of that range. */
+    uint32_t offset = 0;
+    for (auto &vertex : vertices)
+    {
+        vertex.first_triangle = offset;
+        offset += vertex.remaining;
+        vertex.score = vertex_score(vertex);
+    }
+
+    std::vector<uint32_t> adjacency(offset);
+    std::vector<uint32_t> filled(vertex_count, 0);
+    for (auto t = 0u; t < triangle_count; ++t)
+    {
+        for (auto c = 0u; c < 3; ++c)
+        {
+            auto v = indices[t * 3 + c];
+            adjacency[vertices[v].first_triangle + filled[v]++] = t;
+        }
+    }
+
+    std::vector<float> triangle_scores(triangle_count);
+    for (auto t = 0u; t < triangle_count; ++t)
+    {
+        triangle_scores[t] = vertices[indices[t * 3]].score +
+                             vertices[indices[t * 3 + 1]].score +
+                             vertices[indices[t * 3 + 2]].score;
+    }
+
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<uint32_t> output;
+    output.reserve(triangle_count * 3);
+
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> next_cache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    next_cache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+    int64_t best = std::max_element(triangle_scores.begin(), triangle_scores.end()) - triangle_scores.begin();
+    uint32_t scan_position = 0;
+
+    for (auto n = 0u; n < triangle_count; ++n)
+    {
+        if (best < 0)
+        {
+            /* Nothing in the cache touches a remaining triangle, so start again
+             * from the next triangle in the original order */
+            while (emitted[scan_position])
+            {
+                ++scan_position;
+            }
+            best = scan_position;
+        }
+
+        const uint32_t *corners = &indices[best * 3];
+        output.insert(output.end(), corners, corners + 3);
+        emitted[best] = true;
+
+        for (auto c = 0u; c < 3; ++c)
+        {
+            auto &vertex = vertices[corners[c]];
+            auto begin = adjacency.begin() + vertex.first_triangle;
+            auto end = begin + vertex.remaining;
+            auto it = std::find(begin, end, uint32_t(best));
+            std::iter_swap(it, end - 1);
+            vertex.remaining--;
+        }
+
+        /* Move the triangle's vertices to the front of the LRU cache */
+        next_cache.assign(corners, corners + 3);
+        for (auto v : cache)
+        {
+            if (v != corners[0] && v != corners[1] && v != corners[2])
+            {
+                next_cache.push_back(v);
+            }
+        }
+
+        for (auto i = 0u; i < next_cache.size(); ++i)
+        {
+            auto &vertex = vertices[next_cache[i]];
+            vertex.cache_position = (i < FORSYTH_CACHE_SIZE) ? int32_t(i) : -1;
+            vertex.score = vertex_score(vertex);
+        }
+
+        float best_score = -1.0f;
+        best = -1;
+        for (auto v : next_cache)
+        {
+            const auto &vertex = vertices[v];
+            for (auto i = 0u; i < vertex.remaining; ++i)
+            {
+                auto t = adjacency[vertex.first_triangle + i];
+                auto score = vertices[indices[t * 3]].score +
+                             vertices[indices[t * 3 + 1]].score +
+                             vertices[indices[t * 3 + 2]].score;
+                triangle_scores[t] = score;
+
+                if (score > best_score)
+                {
+                    best_score = score;
+                    best = t;
+                }
+            }
+        }
+
+        if (next_cache.size() > FORSYTH_CACHE_SIZE)
+        {
+            next_cache.resize(FORSYTH_CACHE_SIZE);
+        }
+        std::swap(cache, next_cache);
+    }
+
+    output.insert(output.end(), indices.begin() + triangle_count * 3, indices.end());
+    indices.swap(output);
+}
+
+std::vector<uint32_t> optimise_vertex_fetch(std::vector<std::vector<uint32_t> *> &index_lists, uint32_t vertex_count)
+{
+    std::vector<uint32_t> remap(vertex_count, ~0u);
+    uint32_t next = 0;
+
+    for (auto list : index_lists)
+    {
+        for (auto &idx : *list)
+        {
+            if (remap[idx] == ~0u)
+            {
+                remap[idx] = next++;
+            }
+            idx = remap[idx];
+        }
+    }
+
+    for (auto &target : remap)
+    {
+        if (target == ~0u)
+        {
+            target = next++;
+        }
+    }
+
+    return remap;
+}
+
+Report optimise_mesh(MeshPtr mesh)
+{
+    Report report;
+
+    VertexData *vertex_data = mesh->vertex_data.get();
+    const uint32_t vertex_count = vertex_data->count();
+
+    std::vector<IndexData *> targets;
+    std::vector<std::vector<uint32_t>> lists;
+
+    /* Strips, fans and lines keep their index order, but still have to
+     * follow the vertices if they move */
+    std::vector<IndexData *> others;
+    std::vector<std::vector<uint32_t>> other_lists;
+
+    bool reorder_vertices = !mesh->is_animated() && !mesh->has_skeleton();
+
+    /* Meshes sharing the vertex data (generated detail levels, say) index it
+     * too, and reordering it would scramble them. Two references are the
+     * mesh's own and the one shared_from_this() returns. */
+    if (vertex_data->shared_from_this().use_count() > 2)
+    {
+        reorder_vertices = false;
+    }
+
+    for (auto &submesh : mesh->each_submesh())
+    {
+        if (submesh->type() == SUBMESH_TYPE_RANGED)
+        {
+            reorder_vertices = false;
+            continue;
+        }
+
+        IndexData *index_data = submesh->index_data.get();
+        if (std::find(targets.begin(), targets.end(), index_data) != targets.end() ||
+            std::find(others.begin(), others.end(), index_data) != others.end())
+        {
+            continue;
+        }
+
+        if (submesh->arrangement() != MESH_ARRANGEMENT_TRIANGLES)
+        {
+            others.push_back(index_data);
+            other_lists.push_back(index_data->all());
+            continue;
+        }
+
+        targets.push_back(index_data);
+        lists.push_back(index_data->all());
+    }
+
+    float misses_before = 0.0f;
+    float misses_after = 0.0f;
+
+    for (auto &indices : lists)
+    {
+        const uint32_t triangles = indices.size() / 3;
+        misses_before += calculate_acmr(indices) * triangles;
+        optimise_vertex_cache(indices, vertex_count);
+        misses_after += calculate_acmr(indices) * triangles;
+        report.triangles += triangles;
+    }
+
+    if (report.triangles)
+    {
+        report.acmr_before = misses_before / report.triangles;
+        report.acmr_after = misses_after / report.triangles;
+    }
+
+    if (reorder_vertices && vertex_count)
+    {
+        auto remapped = lists;
+        auto other_remapped = other_lists;
+        std::vector<std::vector<uint32_t> *> index_lists;
+        for (auto &indices : remapped)
+        {
+            index_lists.push_back(&indices);
+        }
+        for (auto &indices : other_remapped)
+        {
+            index_lists.push_back(&indices);
+        }
+
+        auto remap = optimise_vertex_fetch(index_lists, vertex_count);
+
+        /* Vertices are renumbered across every submesh, so a submesh whose
+         * vertices end up late in the buffer can outgrow its index type.
+         * IndexData can't change type in place, so leave the order alone. */
+        bool fits = true;
+        for (auto i = 0u; i < targets.size() && fits; ++i)
+        {
+            fits = remapped[i].empty() ||
+                   *std::max_element(remapped[i].begin(), remapped[i].end()) <= index_type_limit(targets[i]->index_type());
+        }
+        for (auto i = 0u; i < others.size() && fits; ++i)
+        {
+            fits = other_remapped[i].empty() ||
+                   *std::max_element(other_remapped[i].begin(), other_remapped[i].end()) <= index_type_limit(others[i]->index_type());
+        }
+
+        if (fits)
+        {
+            lists.swap(remapped);
+            other_lists.swap(other_remapped);
+            targets.insert(targets.end(), others.begin(), others.end());
+            lists.insert(lists.end(), other_lists.begin(), other_lists.end());
+
+            const uint32_t stride = vertex_data->stride();
+            std::vector<uint8_t> original(vertex_data->data(), vertex_data->data() + vertex_count * stride);
+            uint8_t *out = vertex_data->data();
+            for (auto i = 0u; i < vertex_count; ++i)
+            {
+                memcpy(out + remap[i] * stride, &original[i * stride], stride);
+            }
+
+            vertex_data->done();
+        }
+    }
+
+    for (auto i = 0u; i < targets.size(); ++i)
+    {
+        if (lists[i].empty())
+        {
+            continue;
+        }
+
+        targets[i]->clear();
+        targets[i]->index(&lists[i][0], lists[i].size());
+        targets[i]->done();
+    }
+
+    return report;
+}
+
+IndexType smallest_index_type(uint32_t max_index)
+{
+    if (max_index <= 0xFF)
+    {
+        return INDEX_TYPE_8_BIT;
+    }
+    else if (max_index <= 0xFFFF)
+    {
+        return INDEX_TYPE_16_BIT;
+    }
+
+    return INDEX_TYPE_32_BIT;
+}
+
+std::vector<uint32_t> stripify(const std::vector<uint32_t> &indices)
+{
+    const uint32_t triangle_count = indices.size() / 3;
+
+    EdgeMap edges;
+    for (auto t = 0u; t < triangle_count; ++t)
+    {
+        const uint32_t *corners = &indices[t * 3];
+        for (auto c = 0u; c < 3; ++c)
+        {
+            edges.insert(std::make_pair(Edge(corners[c], corners[(c + 1) % 3]), t));
+        }
+    }
+
+    std::vector<bool> used(triangle_count, false);
+    std::vector<uint32_t> taken;
+    std::vector<uint32_t> output;
+
+    for (auto t = 0u; t < triangle_count; ++t)
+    {
+        if (used[t])
+        {
+            continue;
+        }
+
+        /* Try each starting rotation and keep whichever strip runs longest */
+        uint32_t best_rotation = 0;
+        std::size_t best_length = 0;
+        for (auto rotation = 0u; rotation < 3; ++rotation)
+        {
+            auto length = grow_strip(indices, edges, used, taken, t, rotation).size();
+            for (auto undo : taken)
+            {
+                used[undo] = false;
+            }
+            taken.clear();
+
+            if (length > best_length)
+            {
+                best_length = length;
+                best_rotation = rotation;
+            }
+        }
+
+        auto strip = grow_strip(indices, edges, used, taken, t, best_rotation);
+        taken.clear();
+
+        if (!output.empty())
+        {
+            /* Join with degenerates. The new strip has to start on an even
+             * position so that its winding is preserved. */
+            auto last = output.back();
+            output.push_back(last);
+            if (output.size() % 2 == 0)
+            {
+                output.push_back(last);
+            }
+            output.push_back(strip[0]);
+        }
+
+        output.insert(output.end(), strip.begin(), strip.end());
+    }
+
+    return output;
+}
+
+FinaliseReport finalise_mesh(MeshPtr mesh, bool generate_strips)
+{
+    FinaliseReport report;
+
+    /* The mesh can only append submeshes, so once one is rebuilt every
+     * submesh after it is recreated too, to keep their order */
+    struct Rebuild
+    {
+        std::string name;
+        std::array<MaterialPtr, MATERIAL_SLOT_MAX> materials;
+        bool contributes_to_edge_list;
+        MeshArrangement arrangement;
+
+        /* Set for submeshes that are only being moved */
+        IndexDataPtr index_data;
+        VertexRangeList ranges;
+
+        /* Set for submeshes whose indices are being rewritten */
+        std::vector<uint32_t> indices;
+        IndexType type = INDEX_TYPE_16_BIT;
+    };
+
+    std::vector<IndexData *> seen_data;
+    std::vector<IndexData *> shared_data;
+    for (auto &submesh : mesh->each_submesh())
+    {
+        if (submesh->type() != SUBMESH_TYPE_INDEXED)
+        {
+            continue;
+        }
+
+        IndexData *index_data = submesh->index_data.get();
+        if (std::find(seen_data.begin(), seen_data.end(), index_data) != seen_data.end())
+        {
+            shared_data.push_back(index_data);
+        }
+        seen_data.push_back(index_data);
+    }
+
+    std::vector<Rebuild> rebuilds;
+    bool recreatable = true;
+    for (auto &submesh : mesh->each_submesh())
+    {
+        Rebuild rebuild;
+        rebuild.name = submesh->name();
+        rebuild.contributes_to_edge_list = submesh->contributes_to_edge_list();
+        rebuild.arrangement = submesh->arrangement();
+        for (auto slot = 0u; slot < MATERIAL_SLOT_MAX; ++slot)
+        {
+            rebuild.materials[slot] = submesh->material_at_slot(MaterialSlot(slot));
+        }
+
+        /* Submeshes are destroyed by name and created with a slot 0
+         * material, so anything else can't be moved */
+        bool movable = rebuild.materials[MATERIAL_SLOT0] && mesh->find_all_submeshes(rebuild.name).size() == 1;
+
+        if (submesh->type() != SUBMESH_TYPE_INDEXED)
+        {
+            rebuild.ranges.assign(submesh->vertex_ranges(), submesh->vertex_ranges() + submesh->vertex_range_count());
+        }
+        else
+        {
+            IndexData *index_data = submesh->index_data.get();
+            rebuild.index_data = index_data->shared_from_this();
+
+            bool shared = std::find(shared_data.begin(), shared_data.end(), index_data) != shared_data.end();
+            if (index_data->count() && movable && !shared)
+            {
+                rebuild.indices = index_data->all();
+
+                if (generate_strips && rebuild.arrangement == MESH_ARRANGEMENT_TRIANGLES)
+                {
+                    auto strip = stripify(rebuild.indices);
+                    if (strip.size() < rebuild.indices.size())
+                    {
+                        rebuild.indices.swap(strip);
+                        rebuild.arrangement = MESH_ARRANGEMENT_TRIANGLE_STRIP;
+                        report.strips++;
+                    }
+                }
+
+                rebuild.type = smallest_index_type(*std::max_element(rebuild.indices.begin(), rebuild.indices.end()));
+
+                report.index_bytes_before += index_data->data_size();
+                report.index_bytes_after += rebuild.indices.size() * index_type_size(rebuild.type);
+
+                if (rebuild.type != index_data->index_type() || rebuild.arrangement != submesh->arrangement())
+                {
+                    rebuild.index_data.reset();
+                }
+                else
+                {
+                    rebuild.indices.clear();
+                }
+            }
+        }
+
+        if (rebuild.indices.empty() && rebuilds.empty())
+        {
+            /* Nothing before this needs to move */
+            continue;
+        }
+
+        recreatable = recreatable && movable;
+        rebuilds.push_back(std::move(rebuild));
+    }
+
+    if (!recreatable)
+    {
+        /* A submesh after the first rebuild can't be recreated, so leave the
+         * whole mesh as it is */
+        report.index_bytes_after = report.index_bytes_before;
+        report.strips = 0;
+        return report;
+    }
+
+    for (auto &rebuild : rebuilds)
+    {
+        mesh->destroy_submesh(rebuild.name);
+    }
+
+    for (auto &rebuild : rebuilds)
+    {
+        MaterialID material = rebuild.materials[MATERIAL_SLOT0]->id();
+
+        SubMeshPtr submesh;
+        if (rebuild.index_data)
+        {
+            submesh = mesh->new_submesh(rebuild.name, material, rebuild.index_data, rebuild.arrangement);
+        }
+        else if (!rebuild.indices.empty())
+        {
+            submesh = mesh->new_submesh(rebuild.name, material, rebuild.type, rebuild.arrangement);
+            submesh->index_data->index(&rebuild.indices[0], rebuild.indices.size());
+            submesh->index_data->done();
+        }
+        else
+        {
+            submesh = mesh->new_submesh(rebuild.name, material, rebuild.arrangement);
+            for (auto &range : rebuild.ranges)
+            {
+                submesh->add_vertex_range(range.start, range.count);
+            }
+        }
+
+        for (auto slot = 1u; slot < MATERIAL_SLOT_MAX; ++slot)
+        {
+            if (rebuild.materials[slot])
+            {
+                submesh->set_material_at_slot(MaterialSlot(slot), rebuild.materials[slot]);
+            }
+        }
+        submesh->set_contributes_to_edge_list(rebuild.contributes_to_edge_list);
+    }
+
+    return report;
+}
+
+} // namespace mesh_optimiser
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "simulant/simulant.h"
+
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Post-load optimisation passes for mesh index and vertex buffers.
+ *
+ * The loaders index triangles in file order, which makes poor use of the
+ * post-transform vertex cache and scatters vertex fetches. These passes
+ * reorder triangles (Forsyth's linear-speed algorithm) and then vertices to
+ * match, without changing what is drawn.
+ */
+namespace mesh_optimiser
+{
+
+/* FIFO cache size used when reporting ACMR, a reasonable lowest common
+ * denominator for the GPUs we target */
+const uint32_t ACMR_CACHE_SIZE = 16;
+
+/* LRU cache size the Forsyth scoring models */
+const uint32_t FORSYTH_CACHE_SIZE = 32;
+
+struct Report
+{
+    uint32_t triangles = 0;
+    float acmr_before = 0.0f;
+    float acmr_after = 0.0f;
+};
+
+struct FinaliseReport
+{
+    uint32_t index_bytes_before = 0;
+    uint32_t index_bytes_after = 0;
+    uint32_t strips = 0;
+};
+
+/* Average cache miss ratio: transformed vertices per triangle, given a FIFO
+ * cache of cache_size entries. 0.5 is the ideal for a regular grid, 3.0 the
+ * worst case. */
+float calculate_acmr(const std::vector<uint32_t> &indices, uint32_t cache_size = ACMR_CACHE_SIZE);
+
+/* Reorders a triangle list in place for vertex cache locality. vertex_count
+ * must be greater than every index in the list. */
+void optimise_vertex_cache(std::vector<uint32_t> &indices, uint32_t vertex_count);
+
+/* Builds an old -> new vertex remap so that vertices are laid out in the order
+ * they are first referenced across all of the index lists. Vertices that are
+ * never referenced keep their relative order at the end. The index lists are
+ * rewritten through the remap. */
+std::vector<uint32_t> optimise_vertex_fetch(std::vector<std::vector<uint32_t> *> &index_lists, uint32_t vertex_count);
+
+/* Runs both passes over every indexed triangle-list submesh of the mesh.
+ * Strip, fan and line submeshes keep their index order, but are renumbered
+ * along with the vertices. The vertex fetch pass is skipped for animated meshes and for meshes with ranged
+ * submeshes, since both address vertices by position, when the vertex data is
+ * shared with another mesh, and when renumbering would push a submesh's
+ * indices past what its index type holds. Run this before creating meshes
+ * that share the vertex data (e.g. generated detail levels), so their
+ * vertices are still reordered. */
+Report optimise_mesh(smlt::MeshPtr mesh);
+
+/* The narrowest index type that can address max_index */
+smlt::IndexType smallest_index_type(uint32_t max_index);
+
+/* Converts a triangle list into a single triangle strip, joining runs with
+ * degenerate triangles and preserving winding. Works best on a list that has
+ * already been through optimise_vertex_cache(). */
+std::vector<uint32_t> stripify(const std::vector<uint32_t> &indices);
+
+/* Rebuilds each indexed submesh with the narrowest index type that fits it
+ * and, if generate_strips is set, as a triangle strip whenever that needs
+ * fewer indices than the list. Submeshes that share index data or a name
+ * are left alone.
+ *
+ * Submeshes can only be appended, so every submesh after the first rebuilt
+ * one is destroyed and recreated in its original order, with its material
+ * slots, edge list flag and index data or vertex ranges. SubMeshPtrs held
+ * from before are stale afterwards. If any of those submeshes has no slot 0
+ * material or shares its name, the mesh is left as it is. */
+FinaliseReport finalise_mesh(smlt::MeshPtr mesh, bool generate_strips = false);
+
+} // namespace mesh_optimiser
@@ -0,0 +1,579 @@
+#include "mesh_simplifier.h"
+#include "mesh_optimiser.h"
+
+#include <algorithm>
+#include <map>
+#include <math.h>
+#include <tuple>
+
+using namespace smlt;
+
+namespace mesh_simplifier
+{
+
+namespace
+{
+
+/* How much a mismatch in vertex attributes costs relative to the geometric
+ * error, which is measured with the mesh scaled to a unit extent */
+const float ATTRIBUTE_WEIGHT = 0.01f;
+
+/* Symmetric 4x4 error quadric, accumulated from the planes of the triangles
+ * around a vertex */
+struct Quadric
+{
+    float a2 = 0.0f, ab = 0.0f, ac = 0.0f, ad = 0.0f;
+    float b2 = 0.0f, bc = 0.0f, bd = 0.0f;
+    float c2 = 0.0f, cd = 0.0f;
+    float d2 = 0.0f;
+
+    void add_plane(float a, float b, float c, float d, float weight)
+    {
+        a2 += a * a * weight;
+        ab += a * b * weight;
+        ac += a * c * weight;
+        ad += a * d * weight;
+        b2 += b * b * weight;
+        bc += b * c * weight;
+        bd += b * d * weight;
+        c2 += c * c * weight;
+        cd += c * d * weight;
+        d2 += d * d * weight;
+    }
+
+    Quadric &operator+=(const Quadric &rhs)
+    {
+        a2 += rhs.a2;
+        ab += rhs.ab;
+        ac += rhs.ac;
+        ad += rhs.ad;
+        b2 += rhs.b2;
+        bc += rhs.bc;
+        bd += rhs.bd;
+        c2 += rhs.c2;
+        cd += rhs.cd;
+        d2 += rhs.d2;
+        return *this;
+    }
+
+    float error(const Vec3 &p) const
+    {
+        float e = a2 * p.x * p.x + 2.0f * ab * p.x * p.y + 2.0f * ac * p.x * p.z + 2.0f * ad * p.x +
+                  b2 * p.y * p.y + 2.0f * bc * p.y * p.z + 2.0f * bd * p.y +
+                  c2 * p.z * p.z + 2.0f * cd * p.z +
+                  d2;
+        return std::max(e, 0.0f);
+    }
+};
+
+struct Collapse
+{
+    float cost;
+    uint32_t from;
+    uint32_t to;
+
+    bool operator<(const Collapse &rhs) const
+    {
+        return cost < rhs.cost;
+    }
+};
+
+uint32_t resolve(std::vector<uint32_t> &remap, uint32_t v)
+{
+    uint32_t root = v;
+    while (remap[root] != root)
+    {
+        root = remap[root];
+    }
+
+    while (remap[v] != root)
+    {
+        uint32_t next = remap[v];
+        remap[v] = root;
+        v = next;
+    }
+
+    return root;
+}
+
+Vec3 triangle_normal(const Vec3 &a, const Vec3 &b, const Vec3 &c)
+{
+    return (b - a).cross(c - a);
+}
+
+/* Expands a triangle strip into a list, dropping the degenerates that join
+ * its runs */
+std::vector<uint32_t> strip_to_list(const std::vector<uint32_t> &strip)
+{
+    std::vector<uint32_t> list;
+    for (std::size_t i = 0; i + 2 < strip.size(); ++i)
+    {
+        uint32_t a = strip[i], b = strip[i + 1], c = strip[i + 2];
+        if (a == b || b == c || a == c)
+        {
+            continue;
+        }
+
+        if (i % 2 == 0)
+        {
+            list.insert(list.end(), {a, b, c});
+        }
+        else
+        {
+            list.insert(list.end(), {b, a, c});
+        }
+    }
+
+    return list;
+}
+
+} // namespace
+
+std::vector<uint32_t> simplify(
+    const std::vector<uint32_t> &indices,
+    const std::vector<Vec3> &positions,
+    const std::vector<float> &attributes,
+    uint32_t attribute_count,
+    uint32_t target_index_count,
+    float *result_error)
+{
+    const uint32_t vertex_count = positions.size();
+    float max_error = 0.0f;
+
+    if (result_error)
+    {
+        *result_error = 0.0f;
+    }
+
+    if (indices.size() <= target_index_count || !vertex_count)
+    {
+        return indices;
+    }
+
+    /* Work with the mesh scaled to a unit extent so that errors are
+     * comparable between meshes and with the attribute penalty */
+    Vec3 lower = positions[0];
+    Vec3 upper = positions[0];
+    for (auto &p : positions)
+    {
+        lower = Vec3(std::min(lower.x, p.x), std::min(lower.y, p.y), std::min(lower.z, p.z));
+        upper = Vec3(std::max(upper.x, p.x), std::max(upper.y, p.y), std::max(upper.z, p.z));
+    }
+
+    const Vec3 extent = upper - lower;
+    const float largest = std::max(extent.x, std::max(extent.y, extent.z));
+    const float scale = (largest > 0.0f) ? 1.0f / largest : 1.0f;
+
+    std::vector<Vec3> points(vertex_count);
+    for (auto v = 0u; v < vertex_count; ++v)
+    {
+        points[v] = (positions[v] - lower) * scale;
+    }
+
+    /* Vertices sharing a position (split by normals or texture coordinates)
+     * are welded into one group, and collapses happen between groups so that
+     * seams move together */
+    std::map<std::tuple<float, float, float>, uint32_t> welded;
+    std::vector<uint32_t> group(vertex_count);
+    std::vector<std::vector<uint32_t>> members(vertex_count);
+    for (auto v = 0u; v < vertex_count; ++v)
+    {
+        auto key = std::make_tuple(positions[v].x, positions[v].y, positions[v].z);
+        group[v] = welded.insert(std::make_pair(key, v)).first->second;
+        members[group[v]].push_back(v);
+    }
+
+    std::vector<Quadric> quadrics(vertex_count);
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> edge_uses;
+
+    const uint32_t triangle_count = indices.size() / 3;
+    for (auto t = 0u; t < triangle_count; ++t)
+    {
+        uint32_t g[3] = {group[indices[t * 3]], group[indices[t * 3 + 1]], group[indices[t * 3 + 2]]};
+        if (g[0] == g[1] || g[1] == g[2] || g[0] == g[2])
+        {
+            continue;
+        }
+
+        Vec3 normal = triangle_normal(points[g[0]], points[g[1]], points[g[2]]);
+        float area = normal.length();
+        if (area > 0.0f)
+        {
+            normal = normal * (1.0f / area);
+            float d = -normal.dot(points[g[0]]);
+            for (auto c = 0u; c < 3; ++c)
+            {
+                quadrics[g[c]].add_plane(normal.x, normal.y, normal.z, d, area * 0.5f);
+            }
+        }
+
+        for (auto c = 0u; c < 3; ++c)
+        {
+            auto a = g[c], b = g[(c + 1) % 3];
+            edge_uses[std::make_pair(std::min(a, b), std::max(a, b))]++;
+        }
+    }
+
+    /* Open borders and non-manifold edges stay where they are, otherwise the
+     * silhouette of open meshes erodes quickly */
+    std::vector<bool> locked(vertex_count, false);
+    for (auto &edge : edge_uses)
+    {
+        if (edge.second != 2)
+        {
+            locked[edge.first.first] = true;
+            locked[edge.first.second] = true;
+        }
+    }
+
+    auto attribute_distance = [&](uint32_t a, uint32_t b) -> float
+    {
+        float distance = 0.0f;
+        for (auto i = 0u; i < attribute_count; ++i)
+        {
+            float delta = attributes[a * attribute_count + i] - attributes[b * attribute_count + i];
+            distance += delta * delta;
+        }
+        return distance;
+    };
+
+    auto closest_member = [&](uint32_t v, uint32_t target_group) -> uint32_t
+    {
+        uint32_t best = members[target_group][0];
+        float best_distance = attribute_distance(v, best);
+        for (auto w : members[target_group])
+        {
+            float distance = attribute_distance(v, w);
+            if (distance < best_distance)
+            {
+                best = w;
+                best_distance = distance;
+            }
+        }
+        return best;
+    };
+
+    std::vector<uint32_t> vertex_remap(vertex_count);
+    for (auto v = 0u; v < vertex_count; ++v)
+    {
+        vertex_remap[v] = v;
+    }
+
+    std::vector<uint32_t> current = indices;
+    current.resize(triangle_count * 3);
+
+    auto compact = [&]()
+    {
+        std::vector<uint32_t> output;
+        output.reserve(current.size());
+        for (std::size_t i = 0; i < current.size(); i += 3)
+        {
+            uint32_t a = resolve(vertex_remap, current[i]);
+            uint32_t b = resolve(vertex_remap, current[i + 1]);
+            uint32_t c = resolve(vertex_remap, current[i + 2]);
+            if (group[a] == group[b] || group[b] == group[c] || group[a] == group[c])
+            {
+                continue;
+            }
+            output.insert(output.end(), {a, b, c});
+        }
+        current.swap(output);
+    };
+
+    std::vector<bool> referenced(vertex_count);
+    std::vector<bool> touched(vertex_count);
+    std::vector<uint32_t> offsets(vertex_count + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    std::vector<Collapse> candidates;
+
+    while (true)
+    {
+        compact();
+
+        if (current.size() <= target_index_count)
+        {
+            break;
+        }
+
+        /* Group -> triangle adjacency for the flip test */
+        std::fill(offsets.begin(), offsets.end(), 0);
+        std::fill(referenced.begin(), referenced.end(), false);
+        for (auto v : current)
+        {
+            offsets[group[v] + 1]++;
+            referenced[v] = true;
+        }
+        for (auto v = 0u; v < vertex_count; ++v)
+        {
+            offsets[v + 1] += offsets[v];
+        }
+
+        adjacency.resize(current.size());
+        std::vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+        for (std::size_t i = 0; i < current.size(); ++i)
+        {
+            adjacency[filled[group[current[i]]]++] = i / 3;
+        }
+
+        edges.clear();
+        for (std::size_t i = 0; i < current.size(); i += 3)
+        {
+            for (auto c = 0u; c < 3; ++c)
+            {
+                uint32_t a = group[current[i + c]];
+                uint32_t b = group[current[i + (c + 1) % 3]];
+                edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        auto collapse_cost = [&](uint32_t from, uint32_t to) -> float
+        {
+            Quadric combined = quadrics[from];
+            combined += quadrics[to];
+            float cost = combined.error(points[to]);
+
+            if (attribute_count)
+            {
+                float penalty = 0.0f;
+                for (auto v : members[from])
+                {
+                    if (referenced[v])
+                    {
+                        penalty = std::max(penalty, attribute_distance(v, closest_member(v, to)));
+                    }
+                }
+                cost += penalty * ATTRIBUTE_WEIGHT;
+            }
+
+            return cost;
+        };
+
+        candidates.clear();
+        for (auto &edge : edges)
+        {
+            auto a = edge.first, b = edge.second;
+            if (locked[a] && locked[b])
+            {
+                continue;
+            }
+
+            Collapse collapse;
+            if (locked[a])
+            {
+                collapse = {collapse_cost(b, a), b, a};
+            }
+            else if (locked[b])
+            {
+                collapse = {collapse_cost(a, b), a, b};
+            }
+            else
+            {
+                float a_to_b = collapse_cost(a, b);
+                float b_to_a = collapse_cost(b, a);
+                collapse = (a_to_b <= b_to_a) ? Collapse{a_to_b, a, b} : Collapse{b_to_a, b, a};
+            }
+            candidates.push_back(collapse);
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        /* An interior collapse removes two triangles. Stopping at the number
+         * needed keeps later passes working from fresh costs. */
+        const uint32_t triangles = current.size() / 3;
+        const uint32_t wanted = (triangles - target_index_count / 3) / 2 + 1;
+
+        std::fill(touched.begin(), touched.end(), false);
+        uint32_t performed = 0;
+
+        for (auto &collapse : candidates)
+        {
+            if (performed >= wanted)
+            {
+                break;
+            }
+
+            if (touched[collapse.from] || touched[collapse.to])
+            {
+                continue;
+            }
+
+            /* Reject collapses that would flip a surviving triangle, turn it
+             * by more than ~75 degrees or squash it flat. The margins stop
+             * rotations adding up to a flip over several passes. */
+            bool flips = false;
+            for (auto i = offsets[collapse.from]; i < offsets[collapse.from + 1] && !flips; ++i)
+            {
+                const uint32_t *tri = &current[adjacency[i] * 3];
+                uint32_t g[3] = {group[tri[0]], group[tri[1]], group[tri[2]]};
+                if (g[0] == collapse.to || g[1] == collapse.to || g[2] == collapse.to)
+                {
+                    continue;
+                }
+
+                Vec3 before = triangle_normal(points[g[0]], points[g[1]], points[g[2]]);
+                for (auto &corner : g)
+                {
+                    if (corner == collapse.from)
+                    {
+                        corner = collapse.to;
+                    }
+                }
+                Vec3 after = triangle_normal(points[g[0]], points[g[1]], points[g[2]]);
+                float before_length = before.length();
+                float after_length = after.length();
+                flips = before.dot(after) <= 0.25f * before_length * after_length ||
+                        after_length <= before_length * 0.001f;
+            }
+
+            if (flips)
+            {
+                continue;
+            }
+
+            for (auto v : members[collapse.from])
+            {
+                vertex_remap[v] = closest_member(v, collapse.to);
+            }
+            quadrics[collapse.to] += quadrics[collapse.from];
+
+            for (auto i = offsets[collapse.from]; i < offsets[collapse.from + 1]; ++i)
+            {
+                const uint32_t *tri = &current[adjacency[i] * 3];
+                touched[group[tri[0]]] = true;
+                touched[group[tri[1]]] = true;
+                touched[group[tri[2]]] = true;
+            }
+            touched[collapse.to] = true;
+
+            max_error = std::max(max_error, collapse.cost);
+            ++performed;
+        }
+
+        if (!performed)
+        {
+            break;
+        }
+    }
+
+    if (result_error)
+    {
+        *result_error = sqrtf(max_error);
+    }
+
+    return current;
+}
+
+MeshPtr simplify_mesh(AssetManager *assets, MeshPtr mesh, float ratio)
+{
+    if (mesh->is_animated())
+    {
+        return MeshPtr();
+    }
+
+    VertexData *vertex_data = mesh->vertex_data.get();
+    const VertexSpecification &spec = vertex_data->vertex_specification();
+    const uint32_t vertex_count = vertex_data->count();
+
+    const bool use_normals = spec.normal_attribute == VERTEX_ATTRIBUTE_3F;
+    const bool use_texcoords = spec.texcoord0_attribute == VERTEX_ATTRIBUTE_2F;
+    const uint32_t attribute_count = (use_normals ? 3 : 0) + (use_texcoords ? 2 : 0);
+
+    std::vector<Vec3> positions(vertex_count);
+    std::vector<float> attributes;
+    attributes.reserve(vertex_count * attribute_count);
+
+    for (auto i = 0u; i < vertex_count; ++i)
+    {
+        Vec4 p = vertex_data->position_nd_at(i);
+        positions[i] = Vec3(p.x, p.y, p.z);
+
+        if (use_normals)
+        {
+            const Vec3 *n = vertex_data->normal_at<Vec3>(i);
+            attributes.insert(attributes.end(), {n->x, n->y, n->z});
+        }
+
+        if (use_texcoords)
+        {
+            const Vec2 *uv = vertex_data->texcoord0_at<Vec2>(i);
+            attributes.insert(attributes.end(), {uv->x, uv->y});
+        }
+    }
+
+    auto simplified = assets->new_mesh(vertex_data->shared_from_this());
+
+    for (auto &submesh : mesh->each_submesh())
+    {
+        if (submesh->type() != SUBMESH_TYPE_INDEXED || !submesh->material())
+        {
+            continue;
+        }
+
+        std::vector<uint32_t> indices;
+        if (submesh->arrangement() == MESH_ARRANGEMENT_TRIANGLES)
+        {
+            indices = submesh->index_data->all();
+        }
+        else if (submesh->arrangement() == MESH_ARRANGEMENT_TRIANGLE_STRIP)
+        {
+            indices = strip_to_list(submesh->index_data->all());
+        }
+        else
+        {
+            continue;
+        }
+
+        uint32_t target = uint32_t(float(indices.size() / 3) * ratio) * 3;
+        indices = simplify(indices, positions, attributes, attribute_count, target);
+        if (indices.empty())
+        {
+            continue;
+        }
+
+        mesh_optimiser::optimise_vertex_cache(indices, vertex_count);
+
+        auto lod_submesh = simplified->new_submesh(
+            submesh->name(),
+            submesh->material()->id(),
+            submesh->index_data->index_type(),
+            MESH_ARRANGEMENT_TRIANGLES);
+
+        for (auto slot = 1u; slot < MATERIAL_SLOT_MAX; ++slot)
+        {
+            auto &material = submesh->material_at_slot(MaterialSlot(slot));
+            if (material)
+            {
+                lod_submesh->set_material_at_slot(MaterialSlot(slot), material);
+            }
+        }
+
+        lod_submesh->index_data->index(&indices[0], indices.size());
+        lod_submesh->index_data->done();
+    }
+
+    return simplified;
+}
+
+std::array<MeshPtr, DETAIL_LEVEL_MAX> generate_detail_levels(AssetManager *assets, MeshPtr base, const float ratios[DETAIL_LEVEL_MAX])
+{
+    std::array<MeshPtr, DETAIL_LEVEL_MAX> levels;
+    levels[DETAIL_LEVEL_NEAREST] = base;
+
+    for (auto level = DETAIL_LEVEL_NEAR; level < DETAIL_LEVEL_MAX; level = DetailLevel(level + 1))
+    {
+        auto previous = levels[level - 1];
+        float ratio = (ratios[level - 1] > 0.0f) ? ratios[level] / ratios[level - 1] : 0.0f;
+
+        levels[level] = simplify_mesh(assets, previous, ratio);
+        if (!levels[level])
+        {
+            break;
+        }
+    }
+
+    return levels;
+}
+
+} // namespace mesh_simplifier
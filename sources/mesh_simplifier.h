@@ -0,0 +1,57 @@
+#pragma once
+
+#include "simulant/simulant.h"
+
+#include <array>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Quadric error metric mesh simplification, used to generate the lower
+ * detail levels of an actor from its base mesh.
+ *
+ * Simplification only produces new index lists. The simplified meshes share
+ * the base mesh's VertexData, so each extra detail level costs index memory
+ * only.
+ */
+namespace mesh_simplifier
+{
+
+/* Fraction of the base triangle count kept at each detail level */
+const float DEFAULT_DETAIL_LEVEL_RATIOS[smlt::DETAIL_LEVEL_MAX] = {1.0f, 0.5f, 0.25f, 0.125f, 0.0625f};
+
+/* Collapses edges until the list has no more than target_index_count
+ * indices, or no further collapse is allowed. Vertices are never moved or
+ * created. Each collapse merges one vertex position into a neighbouring one.
+ *
+ * Vertices on open borders are locked in place. attributes optionally holds
+ * attribute_count floats per vertex (normals, texture coordinates, ...). When
+ * vertices sharing a position are split by their attributes (a UV seam or a
+ * hard edge), the cost of collapses that would smear those attributes rises,
+ * and each split vertex is redirected to its closest match.
+ *
+ * If result_error is given it receives the largest collapse error, relative
+ * to the mesh's extent. */
+std::vector<uint32_t> simplify(
+    const std::vector<uint32_t> &indices,
+    const std::vector<smlt::Vec3> &positions,
+    const std::vector<float> &attributes,
+    uint32_t attribute_count,
+    uint32_t target_index_count,
+    float *result_error = nullptr);
+
+/* Builds a new mesh sharing mesh's vertex data. Each indexed triangle list or
+ * strip submesh is simplified to ratio of its triangles, then reordered for
+ * the vertex cache. Returns an empty pointer for animated meshes, which don't
+ * draw from the shared vertex data. */
+smlt::MeshPtr simplify_mesh(smlt::AssetManager *assets, smlt::MeshPtr mesh, float ratio);
+
+/* Generates a mesh for each detail level from base, which is returned as the
+ * DETAIL_LEVEL_NEAREST entry. Each level is simplified from the one before it.
+ * Entries are empty if base can't be simplified. */
+std::array<smlt::MeshPtr, smlt::DETAIL_LEVEL_MAX> generate_detail_levels(
+    smlt::AssetManager *assets,
+    smlt::MeshPtr base,
+    const float ratios[smlt::DETAIL_LEVEL_MAX] = DEFAULT_DETAIL_LEVEL_RATIOS);
+
+} // namespace mesh_simplifier
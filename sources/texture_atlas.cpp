@@ -0,0 +1,173 @@
+#include "texture_atlas.h"
+
+#include "simulant/utils/rect_pack.h"
+
+#include <algorithm>
+#include <string.h>
+
+using namespace smlt;
+
+namespace texture_atlas
+{
+
+int32_t Atlas::add(const std::string &name, uint16_t width, uint16_t height, const uint8_t *rgba)
+{
+    /* stb_rect_pack reports empty rectangles as packed, and blit() would then
+     * read the gutter from texels that don't exist */
+    const uint32_t border = config_.gutter * 2;
+    if (!width || !height || width + border > config_.page_width || height + border > config_.page_height)
+    {
+        return -1;
+    }
+
+    Image image;
+    image.name = name;
+    image.width = width;
+    image.height = height;
+    image.rgba.assign(rgba, rgba + uint32_t(width) * height * 4);
+    images_.push_back(std::move(image));
+    return images_.size() - 1;
+}
+
+int32_t Atlas::add(const std::string &name, TexturePtr texture)
+{
+    if (texture->format() != TEXTURE_FORMAT_RGBA_4UB_8888 || !texture->has_data())
+    {
+        return -1;
+    }
+
+    return add(name, texture->width(), texture->height(), texture->data());
+}
+
+int32_t Atlas::find(const std::string &name) const
+{
+    for (uint32_t i = 0; i < images_.size(); ++i)
+    {
+        if (images_[i].name == name)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool Atlas::build()
+{
+    pages_.clear();
+
+    const uint32_t border = config_.gutter * 2;
+    std::vector<uint32_t> pending;
+    for (uint32_t i = 0; i < images_.size(); ++i)
+    {
+        pending.push_back(i);
+    }
+
+    std::vector<stbrp_node> nodes(config_.page_width);
+    while (!pending.empty())
+    {
+        std::vector<stbrp_rect> rects(pending.size());
+        for (uint32_t i = 0; i < pending.size(); ++i)
+        {
+            rects[i].id = pending[i];
+            rects[i].w = stbrp_coord(images_[pending[i]].width + border);
+            rects[i].h = stbrp_coord(images_[pending[i]].height + border);
+        }
+
+        stbrp_context context;
+        stbrp_init_target(&context, config_.page_width, config_.page_height, &nodes[0], nodes.size());
+        stbrp_pack_rects(&context, &rects[0], rects.size());
+
+        const uint32_t page = pages_.size();
+        pages_.push_back(std::vector<uint8_t>(uint32_t(config_.page_width) * config_.page_height * 4));
+
+        pending.clear();
+        for (auto &rect : rects)
+        {
+            if (!rect.was_packed)
+            {
+                pending.push_back(rect.id);
+                continue;
+            }
+
+            Image &image = images_[rect.id];
+            Region &region = image.region;
+            region.page = page;
+            region.x = rect.x + config_.gutter;
+            region.y = rect.y + config_.gutter;
+            region.width = image.width;
+            region.height = image.height;
+            region.uv_offset = Vec2(float(region.x) / config_.page_width, float(region.y) / config_.page_height);
+            region.uv_scale = Vec2(float(region.width) / config_.page_width, float(region.height) / config_.page_height);
+
+            blit(image);
+        }
+
+        if (pending.size() == rects.size())
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void Atlas::blit(const Image &image)
+{
+    const Region &region = image.region;
+    std::vector<uint8_t> &page = pages_[region.page];
+
+    /* The gutter repeats the image's edge texels outwards */
+    const int32_t gutter = config_.gutter;
+    for (int32_t y = -gutter; y < image.height + gutter; ++y)
+    {
+        int32_t source_y = std::min(std::max(y, 0), image.height - 1);
+        for (int32_t x = -gutter; x < image.width + gutter; ++x)
+        {
+            int32_t source_x = std::min(std::max(x, 0), image.width - 1);
+            memcpy(
+                &page[((region.y + y) * config_.page_width + region.x + x) * 4],
+                &image.rgba[(source_y * image.width + source_x) * 4],
+                4);
+        }
+    }
+}
+
+std::vector<TexturePtr> Atlas::create_textures(AssetManager *assets) const
+{
+    std::vector<TexturePtr> textures;
+    for (auto &page : pages_)
+    {
+        auto texture = assets->new_texture(config_.page_width, config_.page_height, TEXTURE_FORMAT_RGBA_4UB_8888);
+        texture->set_data(page);
+        textures.push_back(texture);
+    }
+    return textures;
+}
+
+bool remap_texcoords(MeshPtr mesh, const Region &region)
+{
+    if (mesh->is_animated())
+    {
+        return false;
+    }
+
+    VertexData *vertex_data = mesh->vertex_data.get();
+    if (vertex_data->vertex_specification().texcoord0_attribute != VERTEX_ATTRIBUTE_2F)
+    {
+        return false;
+    }
+
+    for (auto i = 0u; i < vertex_data->count(); ++i)
+    {
+        const Vec2 *uv = vertex_data->texcoord0_at<Vec2>(i);
+        Vec2 mapped(region.uv_offset.x + uv->x * region.uv_scale.x, region.uv_offset.y + uv->y * region.uv_scale.y);
+
+        vertex_data->move_to(i);
+        vertex_data->tex_coord0(mapped);
+    }
+    vertex_data->done();
+
+    return true;
+}
+
+} // namespace texture_atlas
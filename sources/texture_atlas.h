@@ -0,0 +1,94 @@
+#pragma once
+
+#include "simulant/simulant.h"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Packs many small RGBA8888 images into a few texture pages, so geometry
+ * drawn with them can share one material and batch together.
+ *
+ * Each image is surrounded by a gutter of its own edge texels, so bilinear
+ * filtering and the smaller mipmaps don't bleed neighbouring images in.
+ * A gutter of 2^n texels keeps the first n mipmap levels clean.
+ */
+namespace texture_atlas
+{
+
+struct Config
+{
+    uint16_t page_width = 256;
+    uint16_t page_height = 256;
+    uint16_t gutter = 2;
+};
+
+struct Region
+{
+    uint32_t page = 0;
+    uint16_t x = 0;
+    uint16_t y = 0;
+    uint16_t width = 0;
+    uint16_t height = 0;
+
+    /* Maps the image's own 0-1 texture coordinates into the page:
+     * page_uv = uv_offset + uv * uv_scale */
+    smlt::Vec2 uv_offset;
+    smlt::Vec2 uv_scale;
+};
+
+class Atlas
+{
+public:
+    Atlas(const Config &config = Config()) : config_(config) {}
+
+    /* Queues an image of width x height RGBA8888 texels, in the row order the
+     * engine stores textures, and returns its index. Returns -1 if the image
+     * is empty, or it and its gutter are larger than a page. */
+    int32_t add(const std::string &name, uint16_t width, uint16_t height, const uint8_t *rgba);
+
+    /* Queues a texture that still has its RGBA8888 data. Returns -1 if it
+     * can't be used. */
+    int32_t add(const std::string &name, smlt::TexturePtr texture);
+
+    /* Packs every queued image, filling pages in turn. Returns false if the
+     * remaining images can't be packed into a fresh page. */
+    bool build();
+
+    uint32_t page_count() const { return pages_.size(); }
+    const std::vector<uint8_t> &page_data(uint32_t page) const { return pages_[page]; }
+
+    /* Creates a texture for each page. Only valid after build(). */
+    std::vector<smlt::TexturePtr> create_textures(smlt::AssetManager *assets) const;
+
+    const Region &region(uint32_t index) const { return images_[index].region; }
+
+    /* Index of the image added under name, or -1 */
+    int32_t find(const std::string &name) const;
+
+private:
+    struct Image
+    {
+        std::string name;
+        uint16_t width;
+        uint16_t height;
+        std::vector<uint8_t> rgba;
+        Region region;
+    };
+
+    Config config_;
+    std::vector<Image> images_;
+    std::vector<std::vector<uint8_t>> pages_;
+
+    void blit(const Image &image);
+};
+
+/* Rewrites a mesh's 2F texcoord0 through region's UV transform so that it
+ * samples the region's page. Vertices are rewritten once each, however many
+ * submeshes use them, so run this once per vertex data. Texture coordinates
+ * outside 0-1 would sample neighbouring images, as there is no wrapping
+ * within a region. */
+bool remap_texcoords(smlt::MeshPtr mesh, const Region &region);
+
+} // namespace texture_atlas
@@ -0,0 +1,469 @@
+#include "texture_compressor.h"
+#include "texture_converter.h"
+#include "texture_mipmaps.h"
+
+#include <algorithm>
+#include <float.h>
+#include <fstream>
+#include <math.h>
+#include <string.h>
+#include <unordered_map>
+
+using namespace smlt;
+
+namespace texture_compressor
+{
+
+namespace
+{
+
+/* Codebook entries are 2x2 blocks stored in twiddled order: top-left,
+ * bottom-left, top-right, bottom-right */
+const uint32_t BLOCK_TEXELS = 4;
+const uint32_t BLOCK_COMPONENTS = BLOCK_TEXELS * 4;
+const uint32_t CODEBOOK_BYTES = VQ_CODEBOOK_SIZE * BLOCK_TEXELS * sizeof(uint16_t);
+
+/* k-means passes after each split. The intermediate codebooks are only
+ * seeds for the next split, so they get fewer. */
+const uint32_t SPLIT_ITERATIONS = 4;
+const uint32_t FINAL_ITERATIONS = 16;
+const float CONVERGENCE_THRESHOLD = 0.001f; // Relative change in distortion
+const float SPLIT_OFFSET = 1.0f;            // On a 0-255 scale
+
+const uint32_t DTEX_HEADER_SIZE = 16;
+
+/* Pixel formats as numbered in the PowerVR texture control word */
+enum PixelFormat
+{
+    PIXEL_FORMAT_ARGB1555 = 0,
+    PIXEL_FORMAT_RGB565 = 1,
+    PIXEL_FORMAT_ARGB4444 = 2,
+    PIXEL_FORMAT_INVALID = -1
+};
+
+struct FormatInfo
+{
+    PixelFormat pixel_format;
+    bool twiddled;
+    bool vq;
+    bool mipmapped;
+
+    FormatInfo() : pixel_format(PIXEL_FORMAT_INVALID), twiddled(false), vq(false), mipmapped(false) {}
+    FormatInfo(PixelFormat pixel_format, bool twiddled, bool vq, bool mipmapped) : pixel_format(pixel_format), twiddled(twiddled), vq(vq), mipmapped(mipmapped) {}
+};
+
+FormatInfo format_info(TextureFormat format)
+{
+    switch (format)
+    {
+    case TEXTURE_FORMAT_RGB_1US_565:
+        return {PIXEL_FORMAT_RGB565, false, false, false};
+    case TEXTURE_FORMAT_RGB_1US_565_TWID:
+        return {PIXEL_FORMAT_RGB565, true, false, false};
+    case TEXTURE_FORMAT_RGB_1US_565_VQ_TWID:
+        return {PIXEL_FORMAT_RGB565, true, true, false};
+    case TEXTURE_FORMAT_RGB_1US_565_VQ_TWID_MIP:
+        return {PIXEL_FORMAT_RGB565, true, true, true};
+    case TEXTURE_FORMAT_ARGB_1US_4444:
+        return {PIXEL_FORMAT_ARGB4444, false, false, false};
+    case TEXTURE_FORMAT_ARGB_1US_4444_TWID:
+        return {PIXEL_FORMAT_ARGB4444, true, false, false};
+    case TEXTURE_FORMAT_ARGB_1US_4444_VQ_TWID:
+        return {PIXEL_FORMAT_ARGB4444, true, true, false};
+    case TEXTURE_FORMAT_ARGB_1US_4444_VQ_TWID_MIP:
+        return {PIXEL_FORMAT_ARGB4444, true, true, true};
+    case TEXTURE_FORMAT_ARGB_1US_1555:
+        return {PIXEL_FORMAT_ARGB1555, false, false, false};
+    case TEXTURE_FORMAT_ARGB_1US_1555_TWID:
+        return {PIXEL_FORMAT_ARGB1555, true, false, false};
+    case TEXTURE_FORMAT_ARGB_1US_1555_VQ_TWID:
+        return {PIXEL_FORMAT_ARGB1555, true, true, false};
+    case TEXTURE_FORMAT_ARGB_1US_1555_VQ_TWID_MIP:
+        return {PIXEL_FORMAT_ARGB1555, true, true, true};
+    default:
+        return FormatInfo();
+    }
+}
+
+void unpack(uint16_t texel, TextureFormat format, float *rgba)
+{
+    uint8_t rgba8[4];
+    texture_converter::unpack_texel(texel, format, rgba8);
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+        rgba[c] = rgba8[c];
+    }
+}
+
+bool is_power_of_two(uint32_t value)
+{
+    return value && !(value & (value - 1));
+}
+
+/* The chain from width x height down to 1x1, largest first, or just the top
+ * level */
+std::vector<texture_mipmaps::Level> build_levels(const uint8_t *rgba, uint16_t width, uint16_t height, bool mipmapped)
+{
+    if (mipmapped)
+    {
+        return texture_mipmaps::build_chain(rgba, width, height);
+    }
+
+    std::vector<texture_mipmaps::Level> levels(1);
+    levels[0].width = width;
+    levels[0].height = height;
+    levels[0].data.assign(rgba, rgba + uint32_t(width) * height * 4);
+    return levels;
+}
+
+float block_distance(const float *a, const float *b, float limit)
+{
+    float distance = 0.0f;
+    for (uint32_t i = 0; i < BLOCK_COMPONENTS && distance < limit; ++i)
+    {
+        float d = a[i] - b[i];
+        distance += d * d;
+    }
+    return distance;
+}
+
+uint32_t nearest_entry(const float *block, const std::vector<float> &codebook, uint32_t entries, float *result_distance)
+{
+    uint32_t nearest = 0;
+    float best = FLT_MAX;
+    for (uint32_t i = 0; i < entries; ++i)
+    {
+        float distance = block_distance(block, &codebook[i * BLOCK_COMPONENTS], best);
+        if (distance < best)
+        {
+            best = distance;
+            nearest = i;
+        }
+    }
+
+    *result_distance = best;
+    return nearest;
+}
+
+/* Weighted k-means over the first entries of the codebook */
+void refine(const std::vector<float> &blocks, const std::vector<uint32_t> &weights, std::vector<float> &codebook, uint32_t entries, uint32_t iterations)
+{
+    uint32_t count = weights.size();
+    std::vector<double> sums(entries * BLOCK_COMPONENTS);
+    std::vector<uint32_t> totals(entries);
+
+    float previous = FLT_MAX;
+    for (uint32_t iteration = 0; iteration < iterations; ++iteration)
+    {
+        std::fill(sums.begin(), sums.end(), 0.0);
+        std::fill(totals.begin(), totals.end(), 0);
+
+        double distortion = 0.0;
+        uint32_t worst_block = 0;
+        float worst_distance = -1.0f;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const float *block = &blocks[i * BLOCK_COMPONENTS];
+
+            float distance;
+            uint32_t entry = nearest_entry(block, codebook, entries, &distance);
+            distortion += distance * weights[i];
+            if (distance > worst_distance)
+            {
+                worst_distance = distance;
+                worst_block = i;
+            }
+
+            totals[entry] += weights[i];
+            for (uint32_t c = 0; c < BLOCK_COMPONENTS; ++c)
+            {
+                sums[entry * BLOCK_COMPONENTS + c] += block[c] * weights[i];
+            }
+        }
+
+        for (uint32_t entry = 0; entry < entries; ++entry)
+        {
+            float *centroid = &codebook[entry * BLOCK_COMPONENTS];
+            if (!totals[entry])
+            {
+                /* Reseed an empty entry with the worst-served block. Only
+                 * one per pass, as the next pass may have served it. */
+                if (worst_distance > 0.0f)
+                {
+                    memcpy(centroid, &blocks[worst_block * BLOCK_COMPONENTS], sizeof(float) * BLOCK_COMPONENTS);
+                    worst_distance = 0.0f;
+                }
+                continue;
+            }
+
+            for (uint32_t c = 0; c < BLOCK_COMPONENTS; ++c)
+            {
+                centroid[c] = float(sums[entry * BLOCK_COMPONENTS + c] / totals[entry]);
+            }
+        }
+
+        if (previous - distortion <= previous * CONVERGENCE_THRESHOLD)
+        {
+            break;
+        }
+        previous = distortion;
+    }
+}
+
+std::vector<float> train_codebook(const std::vector<float> &blocks, const std::vector<uint32_t> &weights)
+{
+    uint32_t count = weights.size();
+    std::vector<float> codebook(VQ_CODEBOOK_SIZE * BLOCK_COMPONENTS);
+
+    /* Few enough distinct blocks to store them all exactly */
+    if (count <= VQ_CODEBOOK_SIZE)
+    {
+        std::copy(blocks.begin(), blocks.end(), codebook.begin());
+        return codebook;
+    }
+
+    double total = 0.0;
+    std::vector<double> mean(BLOCK_COMPONENTS);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        for (uint32_t c = 0; c < BLOCK_COMPONENTS; ++c)
+        {
+            mean[c] += blocks[i * BLOCK_COMPONENTS + c] * weights[i];
+        }
+        total += weights[i];
+    }
+
+    for (uint32_t c = 0; c < BLOCK_COMPONENTS; ++c)
+    {
+        codebook[c] = float(mean[c] / total);
+    }
+
+    uint32_t entries = 1;
+    while (entries < VQ_CODEBOOK_SIZE)
+    {
+        uint32_t split = std::min(entries, VQ_CODEBOOK_SIZE - entries);
+        for (uint32_t entry = 0; entry < split; ++entry)
+        {
+            float *source = &codebook[entry * BLOCK_COMPONENTS];
+            float *target = &codebook[(entries + entry) * BLOCK_COMPONENTS];
+            for (uint32_t c = 0; c < BLOCK_COMPONENTS; ++c)
+            {
+                target[c] = source[c] + SPLIT_OFFSET;
+                source[c] -= SPLIT_OFFSET;
+            }
+        }
+        entries += split;
+
+        refine(blocks, weights, codebook, entries, (entries == VQ_CODEBOOK_SIZE) ? FINAL_ITERATIONS : SPLIT_ITERATIONS);
+    }
+
+    return codebook;
+}
+
+} // namespace
+
+bool is_vq_format(TextureFormat format)
+{
+    return format_info(format).vq;
+}
+
+std::vector<uint8_t> compress_vq(const uint8_t *rgba, uint16_t width, uint16_t height, TextureFormat format, Report *report)
+{
+    FormatInfo info = format_info(format);
+    if (!info.vq || !is_power_of_two(width) || !is_power_of_two(height) ||
+        width < 8 || height < 8 || width > 1024 || height > 1024 ||
+        (info.mipmapped && width != height))
+    {
+        return std::vector<uint8_t>();
+    }
+
+    /* Quantise every block to the target precision first. Textures tend to
+     * repeat blocks a lot, so training runs over the distinct ones, weighted
+     * by how often they occur. */
+    auto levels = build_levels(rgba, width, height, info.mipmapped);
+
+    std::vector<uint32_t> block_ids;
+    std::vector<float> blocks;
+    std::vector<uint32_t> weights;
+    std::unordered_map<uint64_t, uint32_t> ids;
+    for (auto &level : levels)
+    {
+        uint32_t blocks_wide = std::max<uint32_t>(level.width / 2, 1);
+        uint32_t blocks_high = std::max<uint32_t>(level.height / 2, 1);
+        for (uint32_t by = 0; by < blocks_high; ++by)
+        {
+            for (uint32_t bx = 0; bx < blocks_wide; ++bx)
+            {
+                uint64_t key = 0;
+                for (uint32_t i = 0; i < BLOCK_TEXELS; ++i)
+                {
+                    /* The clamp repeats the texel of a 1x1 level */
+                    uint32_t x = std::min<uint32_t>(bx * 2 + (i >> 1), level.width - 1);
+                    uint32_t y = std::min<uint32_t>(by * 2 + (i & 1), level.height - 1);
+                    key |= uint64_t(texture_converter::pack_texel(&level.data[(y * level.width + x) * 4], format)) << (i * 16);
+                }
+
+                auto it = ids.find(key);
+                if (it == ids.end())
+                {
+                    it = ids.insert(std::make_pair(key, uint32_t(weights.size()))).first;
+                    weights.push_back(0);
+                    blocks.resize(blocks.size() + BLOCK_COMPONENTS);
+                    for (uint32_t i = 0; i < BLOCK_TEXELS; ++i)
+                    {
+                        unpack(uint16_t(key >> (i * 16)), format, &blocks[it->second * BLOCK_COMPONENTS + i * 4]);
+                    }
+                }
+
+                weights[it->second]++;
+                block_ids.push_back(it->second);
+            }
+        }
+    }
+
+    auto codebook = train_codebook(blocks, weights);
+
+    /* Round the codebook to the target format, then map each distinct block
+     * to its nearest entry as it will actually be drawn */
+    std::vector<uint8_t> data(CODEBOOK_BYTES);
+    for (uint32_t texel = 0; texel < VQ_CODEBOOK_SIZE * BLOCK_TEXELS; ++texel)
+    {
+        uint8_t rgba8[4];
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            rgba8[c] = uint8_t(std::min(std::max(codebook[texel * 4 + c] + 0.5f, 0.0f), 255.0f));
+        }
+
+        uint16_t packed = texture_converter::pack_texel(rgba8, format);
+        data[texel * 2] = packed & 0xFF;
+        data[texel * 2 + 1] = packed >> 8;
+        unpack(packed, format, &codebook[texel * 4]);
+    }
+
+    double error = 0.0;
+    std::vector<uint8_t> block_entries(weights.size());
+    for (uint32_t i = 0; i < weights.size(); ++i)
+    {
+        float distance;
+        block_entries[i] = nearest_entry(&blocks[i * BLOCK_COMPONENTS], codebook, VQ_CODEBOOK_SIZE, &distance);
+        error += distance * weights[i];
+    }
+
+    /* Levels are stored smallest first. The 1x1 level of a mipmapped
+     * texture takes one index, like the 2x2 level. */
+    uint32_t first_block = block_ids.size();
+    for (auto level = levels.rbegin(); level != levels.rend(); ++level)
+    {
+        uint32_t blocks_wide = std::max<uint32_t>(level->width / 2, 1);
+        uint32_t blocks_high = std::max<uint32_t>(level->height / 2, 1);
+        first_block -= blocks_wide * blocks_high;
+
+        uint32_t offset = data.size();
+        data.resize(offset + blocks_wide * blocks_high);
+        for (uint32_t by = 0; by < blocks_high; ++by)
+        {
+            for (uint32_t bx = 0; bx < blocks_wide; ++bx)
+            {
+                uint32_t id = block_ids[first_block + by * blocks_wide + bx];
+                data[offset + texture_converter::twiddled_offset(bx, by, blocks_wide, blocks_high)] = block_entries[id];
+            }
+        }
+    }
+
+    if (report)
+    {
+        report->blocks = block_ids.size();
+        report->unique_blocks = weights.size();
+        report->rms_error = sqrtf(float(error / (block_ids.size() * BLOCK_COMPONENTS)));
+        report->bytes_before = uint32_t(width) * height * 4;
+        report->bytes_after = data.size();
+    }
+
+    return data;
+}
+
+bool compress_texture(TexturePtr texture, TextureFormat format, Report *report)
+{
+    if (!is_vq_format(format) || !texture->has_data())
+    {
+        return false;
+    }
+
+    if (texture->format() != TEXTURE_FORMAT_RGBA_4UB_8888 && !texture->convert(TEXTURE_FORMAT_RGBA_4UB_8888))
+    {
+        return false;
+    }
+
+    auto data = compress_vq(texture->data(), texture->width(), texture->height(), format, report);
+    if (data.empty())
+    {
+        return false;
+    }
+
+    texture->set_format(format);
+    texture->resize(texture->width(), texture->height(), data.size());
+    texture->set_data(data);
+
+    if (texture_format_contains_mipmaps(format))
+    {
+        texture->set_mipmap_generation(MIPMAP_GENERATE_NONE);
+    }
+
+    return true;
+}
+
+std::vector<uint8_t> build_dtex(TextureFormat format, uint16_t width, uint16_t height, const std::vector<uint8_t> &data)
+{
+    FormatInfo info = format_info(format);
+    if (info.pixel_format == PIXEL_FORMAT_INVALID)
+    {
+        return std::vector<uint8_t>();
+    }
+
+    uint32_t type = uint32_t(info.pixel_format) << 27;
+    if (info.mipmapped)
+    {
+        type |= 1u << 31;
+    }
+    if (info.vq)
+    {
+        type |= 1u << 30;
+    }
+    if (!info.twiddled)
+    {
+        type |= 1u << 26;
+    }
+
+    uint32_t size = data.size();
+    uint8_t header[DTEX_HEADER_SIZE] = {
+        'D', 'T', 'E', 'X',
+        uint8_t(width), uint8_t(width >> 8),
+        uint8_t(height), uint8_t(height >> 8),
+        uint8_t(type), uint8_t(type >> 8), uint8_t(type >> 16), uint8_t(type >> 24),
+        uint8_t(size), uint8_t(size >> 8), uint8_t(size >> 16), uint8_t(size >> 24)};
+
+    std::vector<uint8_t> file(header, header + DTEX_HEADER_SIZE);
+    file.insert(file.end(), data.begin(), data.end());
+    return file;
+}
+
+bool save_dtex(TexturePtr texture, const std::string &filename)
+{
+    if (!texture->has_data())
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> data(texture->data(), texture->data() + texture->data_size());
+    auto file = build_dtex(texture->format(), texture->width(), texture->height(), data);
+    if (file.empty())
+    {
+        return false;
+    }
+
+    std::ofstream stream(filename, std::ios::binary);
+    stream.write((const char *)&file[0], file.size());
+    return stream.good();
+}
+
+} // namespace texture_compressor
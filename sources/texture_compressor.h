@@ -0,0 +1,62 @@
+#pragma once
+
+#include "simulant/simulant.h"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Vector quantisation for the PowerVR's VQ texture formats.
+ *
+ * Each 2x2 block of texels is replaced by a one byte index into a codebook of
+ * 256 blocks, which is roughly 8:1 against the 16-bit formats. The codebook is
+ * trained with LBG: it starts from the mean block and repeatedly splits every
+ * entry in two, refining with weighted k-means after each split.
+ *
+ * Training is far too slow to run on the Dreamcast for anything but small
+ * textures. The intended use is to compress on a desktop build and write the
+ * result out with save_dtex(), then ship the .dtex.
+ */
+namespace texture_compressor
+{
+
+const uint32_t VQ_CODEBOOK_SIZE = 256;
+
+struct Report
+{
+    uint32_t blocks = 0;
+    uint32_t unique_blocks = 0;
+    float rms_error = 0.0f; // Per channel, on a 0-255 scale
+    uint32_t bytes_before = 0;
+    uint32_t bytes_after = 0;
+};
+
+/* True for the TEXTURE_FORMAT_*_VQ_TWID and *_VQ_TWID_MIP formats */
+bool is_vq_format(smlt::TextureFormat format);
+
+/* Compresses width x height RGBA8888 texels, in the row order the texture
+ * stores them, to the VQ format's data: the codebook followed by the twiddled
+ * indices of each level, smallest mipmap first. Both dimensions must be powers
+ * of two from 8 to 1024, and equal for the mipmapped formats. Returns an empty
+ * vector otherwise. */
+std::vector<uint8_t> compress_vq(
+    const uint8_t *rgba,
+    uint16_t width,
+    uint16_t height,
+    smlt::TextureFormat format,
+    Report *report = nullptr);
+
+/* Converts the texture's data to format, which must be a VQ format. The
+ * texture must still have its data, in a format that can be converted to
+ * RGBA8888. */
+bool compress_texture(smlt::TexturePtr texture, smlt::TextureFormat format, Report *report = nullptr);
+
+/* The texture's data wrapped in the DTEX header DTEXLoader reads. Only the
+ * PowerVR's native 16-bit, twiddled and VQ formats can be stored. Returns an
+ * empty vector for anything else. */
+std::vector<uint8_t> build_dtex(smlt::TextureFormat format, uint16_t width, uint16_t height, const std::vector<uint8_t> &data);
+
+bool save_dtex(smlt::TexturePtr texture, const std::string &filename);
+
+} // namespace texture_compressor
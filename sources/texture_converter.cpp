@@ -0,0 +1,393 @@
+#include "texture_converter.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace smlt;
+
+namespace texture_converter
+{
+
+namespace
+{
+
+const uint32_t MAX_DIMENSION = 1024;
+
+/* Rounding offsets added before dividing by 255, from a 4x4 Bayer matrix.
+ * Each is (b + 0.5) / 16 of the way through a quantisation step, so they
+ * average out to plain rounding. */
+const uint32_t BAYER_BIAS[4][4] = {
+    {8, 135, 40, 167},
+    {199, 72, 231, 104},
+    {56, 183, 24, 151},
+    {247, 120, 215, 88}};
+
+const uint32_t ROUND_BIAS[4] = {127, 127, 127, 127};
+
+/* spread[i] has the bits of i moved to the even bit positions */
+const std::vector<uint32_t> &spread_table()
+{
+    static const std::vector<uint32_t> table = []() {
+        std::vector<uint32_t> ret(MAX_DIMENSION);
+        for (uint32_t i = 0; i < MAX_DIMENSION; ++i)
+        {
+            for (uint32_t bit = 0; (1u << bit) < MAX_DIMENSION; ++bit)
+            {
+                ret[i] |= ((i >> bit) & 1) << (bit * 2);
+            }
+        }
+        return ret;
+    }();
+    return table;
+}
+
+uint32_t log2(uint32_t value)
+{
+    uint32_t ret = 0;
+    while (value >>= 1)
+    {
+        ++ret;
+    }
+    return ret;
+}
+
+bool can_twiddle(uint32_t width, uint32_t height)
+{
+    return width && height && width <= MAX_DIMENSION && height <= MAX_DIMENSION &&
+           !(width & (width - 1)) && !(height & (height - 1));
+}
+
+struct Pack565
+{
+    static uint16_t pack(const uint8_t *rgba, uint32_t bias)
+    {
+        return ((rgba[0] * 31 + bias) / 255) << 11 | ((rgba[1] * 63 + bias) / 255) << 5 | (rgba[2] * 31 + bias) / 255;
+    }
+};
+
+struct Pack4444
+{
+    static uint16_t pack(const uint8_t *rgba, uint32_t bias)
+    {
+        return ((rgba[3] * 15 + 127) / 255) << 12 | ((rgba[0] * 15 + bias) / 255) << 8 |
+               ((rgba[1] * 15 + bias) / 255) << 4 | (rgba[2] * 15 + bias) / 255;
+    }
+};
+
+struct Pack1555
+{
+    static uint16_t pack(const uint8_t *rgba, uint32_t bias)
+    {
+        return (rgba[3] >= 128) << 15 | ((rgba[0] * 31 + bias) / 255) << 10 |
+               ((rgba[1] * 31 + bias) / 255) << 5 | (rgba[2] * 31 + bias) / 255;
+    }
+};
+
+struct PackRGBA4444
+{
+    static uint16_t pack(const uint8_t *rgba, uint32_t bias)
+    {
+        return ((rgba[0] * 15 + bias) / 255) << 12 | ((rgba[1] * 15 + bias) / 255) << 8 |
+               ((rgba[2] * 15 + bias) / 255) << 4 | (rgba[3] * 15 + 127) / 255;
+    }
+};
+
+struct Pack5551
+{
+    static uint16_t pack(const uint8_t *rgba, uint32_t bias)
+    {
+        return ((rgba[0] * 31 + bias) / 255) << 11 | ((rgba[1] * 31 + bias) / 255) << 6 |
+               ((rgba[2] * 31 + bias) / 255) << 1 | (rgba[3] >= 128);
+    }
+};
+
+/* Packs and, if twiddled, reorders in one pass. The twiddled offset is built
+ * from the spread table: the row's bits once per row, the column's per texel. */
+template <typename Packer>
+void pack_texels(const uint8_t *rgba, uint32_t width, uint32_t height, bool dither, bool twiddled, uint16_t *dest)
+{
+    const auto &spread = spread_table();
+    uint32_t size = std::min(width, height);
+    uint32_t mask = size - 1;
+    uint32_t shift = log2(size);
+
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const uint8_t *row = rgba + y * width * 4;
+        const uint32_t *bias = dither ? BAYER_BIAS[y & 3] : ROUND_BIAS;
+
+        if (!twiddled)
+        {
+            uint16_t *out = dest + y * width;
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                out[x] = Packer::pack(row + x * 4, bias[x & 3]);
+            }
+            continue;
+        }
+
+        uint32_t row_offset = spread[y & mask] | (((height > width) ? y >> shift : 0) << (shift * 2));
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            uint32_t offset = row_offset | spread[x & mask] << 1 | ((width > height) ? (x >> shift) << (shift * 2) : 0);
+            dest[offset] = Packer::pack(row + x * 4, bias[x & 3]);
+        }
+    }
+}
+
+/* The same texel layout's plain formats, or TEXTURE_FORMAT_INVALID */
+TextureFormat base_format(TextureFormat format)
+{
+    switch (format)
+    {
+    case TEXTURE_FORMAT_RGB_1US_565:
+    case TEXTURE_FORMAT_RGB_1US_565_TWID:
+    case TEXTURE_FORMAT_RGB_1US_565_VQ_TWID:
+    case TEXTURE_FORMAT_RGB_1US_565_VQ_TWID_MIP:
+        return TEXTURE_FORMAT_RGB_1US_565;
+    case TEXTURE_FORMAT_ARGB_1US_4444:
+    case TEXTURE_FORMAT_ARGB_1US_4444_TWID:
+    case TEXTURE_FORMAT_ARGB_1US_4444_VQ_TWID:
+    case TEXTURE_FORMAT_ARGB_1US_4444_VQ_TWID_MIP:
+        return TEXTURE_FORMAT_ARGB_1US_4444;
+    case TEXTURE_FORMAT_ARGB_1US_1555:
+    case TEXTURE_FORMAT_ARGB_1US_1555_TWID:
+    case TEXTURE_FORMAT_ARGB_1US_1555_VQ_TWID:
+    case TEXTURE_FORMAT_ARGB_1US_1555_VQ_TWID_MIP:
+        return TEXTURE_FORMAT_ARGB_1US_1555;
+    case TEXTURE_FORMAT_RGBA_1US_4444:
+        return TEXTURE_FORMAT_RGBA_1US_4444;
+    case TEXTURE_FORMAT_RGBA_1US_5551:
+        return TEXTURE_FORMAT_RGBA_1US_5551;
+    default:
+        return TEXTURE_FORMAT_INVALID;
+    }
+}
+
+uint8_t expand(uint32_t value, uint32_t max)
+{
+    return uint8_t((value * 255 + max / 2) / max);
+}
+
+} // namespace
+
+uint32_t twiddled_offset(uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+    const auto &spread = spread_table();
+    uint32_t size = std::min(width, height);
+    uint32_t mask = size - 1;
+    uint32_t shift = log2(size);
+
+    return spread[y & mask] | spread[x & mask] << 1 | (((width > height) ? x : y) >> shift) << (shift * 2);
+}
+
+void twiddle(const uint16_t *source, uint16_t *dest, uint16_t width, uint16_t height)
+{
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            dest[twiddled_offset(x, y, width, height)] = source[y * width + x];
+        }
+    }
+}
+
+void untwiddle(const uint16_t *source, uint16_t *dest, uint16_t width, uint16_t height)
+{
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            dest[y * width + x] = source[twiddled_offset(x, y, width, height)];
+        }
+    }
+}
+
+bool is_packed_format(TextureFormat format)
+{
+    return base_format(format) != TEXTURE_FORMAT_INVALID;
+}
+
+uint16_t pack_texel(const uint8_t *rgba, TextureFormat format)
+{
+    switch (base_format(format))
+    {
+    case TEXTURE_FORMAT_RGB_1US_565:
+        return Pack565::pack(rgba, 127);
+    case TEXTURE_FORMAT_ARGB_1US_4444:
+        return Pack4444::pack(rgba, 127);
+    case TEXTURE_FORMAT_ARGB_1US_1555:
+        return Pack1555::pack(rgba, 127);
+    case TEXTURE_FORMAT_RGBA_1US_4444:
+        return PackRGBA4444::pack(rgba, 127);
+    case TEXTURE_FORMAT_RGBA_1US_5551:
+        return Pack5551::pack(rgba, 127);
+    default:
+        return 0;
+    }
+}
+
+void unpack_texel(uint16_t texel, TextureFormat format, uint8_t *rgba)
+{
+    switch (base_format(format))
+    {
+    case TEXTURE_FORMAT_RGB_1US_565:
+        rgba[0] = expand((texel >> 11) & 31, 31);
+        rgba[1] = expand((texel >> 5) & 63, 63);
+        rgba[2] = expand(texel & 31, 31);
+        rgba[3] = 255;
+        break;
+    case TEXTURE_FORMAT_ARGB_1US_4444:
+        rgba[0] = expand((texel >> 8) & 15, 15);
+        rgba[1] = expand((texel >> 4) & 15, 15);
+        rgba[2] = expand(texel & 15, 15);
+        rgba[3] = expand(texel >> 12, 15);
+        break;
+    case TEXTURE_FORMAT_ARGB_1US_1555:
+        rgba[0] = expand((texel >> 10) & 31, 31);
+        rgba[1] = expand((texel >> 5) & 31, 31);
+        rgba[2] = expand(texel & 31, 31);
+        rgba[3] = (texel >> 15) ? 255 : 0;
+        break;
+    case TEXTURE_FORMAT_RGBA_1US_4444:
+        rgba[0] = expand(texel >> 12, 15);
+        rgba[1] = expand((texel >> 8) & 15, 15);
+        rgba[2] = expand((texel >> 4) & 15, 15);
+        rgba[3] = expand(texel & 15, 15);
+        break;
+    case TEXTURE_FORMAT_RGBA_1US_5551:
+        rgba[0] = expand(texel >> 11, 31);
+        rgba[1] = expand((texel >> 6) & 31, 31);
+        rgba[2] = expand((texel >> 1) & 31, 31);
+        rgba[3] = (texel & 1) ? 255 : 0;
+        break;
+    default:
+        rgba[0] = rgba[1] = rgba[2] = rgba[3] = 0;
+        break;
+    }
+}
+
+bool pack(const uint8_t *rgba, uint16_t width, uint16_t height, TextureFormat format, bool dither, uint16_t *dest)
+{
+    bool twiddled;
+    switch (format)
+    {
+    case TEXTURE_FORMAT_RGB_1US_565:
+    case TEXTURE_FORMAT_ARGB_1US_4444:
+    case TEXTURE_FORMAT_ARGB_1US_1555:
+    case TEXTURE_FORMAT_RGBA_1US_4444:
+    case TEXTURE_FORMAT_RGBA_1US_5551:
+        twiddled = false;
+        break;
+    case TEXTURE_FORMAT_RGB_1US_565_TWID:
+    case TEXTURE_FORMAT_ARGB_1US_4444_TWID:
+    case TEXTURE_FORMAT_ARGB_1US_1555_TWID:
+        if (!can_twiddle(width, height))
+        {
+            return false;
+        }
+        twiddled = true;
+        break;
+    default:
+        return false;
+    }
+
+    switch (base_format(format))
+    {
+    case TEXTURE_FORMAT_RGB_1US_565:
+        pack_texels<Pack565>(rgba, width, height, dither, twiddled, dest);
+        break;
+    case TEXTURE_FORMAT_ARGB_1US_4444:
+        pack_texels<Pack4444>(rgba, width, height, dither, twiddled, dest);
+        break;
+    case TEXTURE_FORMAT_RGBA_1US_4444:
+        pack_texels<PackRGBA4444>(rgba, width, height, dither, twiddled, dest);
+        break;
+    case TEXTURE_FORMAT_RGBA_1US_5551:
+        pack_texels<Pack5551>(rgba, width, height, dither, twiddled, dest);
+        break;
+    default:
+        pack_texels<Pack1555>(rgba, width, height, dither, twiddled, dest);
+        break;
+    }
+
+    return true;
+}
+
+NativeFormats native_formats(Renderer *renderer)
+{
+    NativeFormats formats;
+    formats.rgb565 = renderer->natively_supports_texture_format(TEXTURE_FORMAT_RGB_1US_565_TWID);
+    formats.argb1555 = renderer->natively_supports_texture_format(TEXTURE_FORMAT_ARGB_1US_1555_TWID);
+    formats.argb4444 = renderer->natively_supports_texture_format(TEXTURE_FORMAT_ARGB_1US_4444_TWID);
+    return formats;
+}
+
+TextureFormat choose_format(const NativeFormats &formats, const uint8_t *rgba, uint32_t texel_count)
+{
+    bool has_alpha = false;
+    bool partial_alpha = false;
+    for (uint32_t i = 0; i < texel_count && !partial_alpha; ++i)
+    {
+        uint8_t alpha = rgba[i * 4 + 3];
+        has_alpha = has_alpha || alpha != 255;
+        partial_alpha = alpha != 255 && alpha != 0;
+    }
+
+    if (partial_alpha)
+    {
+        return formats.argb4444 ? TEXTURE_FORMAT_ARGB_1US_4444_TWID : TEXTURE_FORMAT_INVALID;
+    }
+    else if (has_alpha)
+    {
+        return formats.argb1555 ? TEXTURE_FORMAT_ARGB_1US_1555_TWID : TEXTURE_FORMAT_INVALID;
+    }
+
+    return formats.rgb565 ? TEXTURE_FORMAT_RGB_1US_565_TWID : TEXTURE_FORMAT_INVALID;
+}
+
+Conversion convert(const NativeFormats &formats, const std::vector<uint8_t> &rgba, uint16_t width, uint16_t height, bool dither)
+{
+    Conversion conversion;
+    if (rgba.size() != uint32_t(width) * height * 4 || !can_twiddle(width, height))
+    {
+        return conversion;
+    }
+
+    TextureFormat format = choose_format(formats, &rgba[0], uint32_t(width) * height);
+    if (format == TEXTURE_FORMAT_INVALID)
+    {
+        return conversion;
+    }
+
+    conversion.data.resize(uint32_t(width) * height * sizeof(uint16_t));
+    pack(&rgba[0], width, height, format, dither, (uint16_t *)&conversion.data[0]);
+    conversion.format = format;
+    return conversion;
+}
+
+float measure_throughput(TextureFormat format, bool dither, uint16_t width, uint16_t height, uint32_t runs)
+{
+    std::vector<uint8_t> rgba(uint32_t(width) * height * 4);
+    for (uint32_t i = 0; i < rgba.size(); ++i)
+    {
+        rgba[i] = uint8_t(i * 37 + (i >> 10));
+    }
+
+    std::vector<uint16_t> dest(uint32_t(width) * height);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t run = 0; run < runs; ++run)
+    {
+        if (!pack(&rgba[0], width, height, format, dither, &dest[0]))
+        {
+            return 0.0f;
+        }
+    }
+    std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+
+    float megabytes = float(rgba.size()) * runs / (1024.0f * 1024.0f);
+    return (elapsed.count() > 0.0f) ? megabytes / elapsed.count() : 0.0f;
+}
+
+} // namespace texture_converter
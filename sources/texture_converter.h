@@ -0,0 +1,86 @@
+#pragma once
+
+#include "simulant/simulant.h"
+
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Conversion of RGBA8888 texture data to the PowerVR's 16-bit formats.
+ *
+ * Textures decoded from PNG arrive as RGBA8888, which the renderer otherwise
+ * converts on the main thread when they're first drawn. These kernels pack to
+ * 565, 4444, 1555 or 5551 with ordered dithering and, for the twiddled
+ * formats, write straight to twiddled order in the same pass.
+ */
+namespace texture_converter
+{
+
+struct Conversion
+{
+    smlt::TextureFormat format = smlt::TEXTURE_FORMAT_INVALID;
+    std::vector<uint8_t> data;
+};
+
+/* Which of the formats choose_format() picks from the renderer takes
+ * natively. Renderer isn't thread-safe, so ask it on the main thread with
+ * native_formats() and hand the answers to the worker. The default has
+ * nothing native, which leaves data as RGBA8888. */
+struct NativeFormats
+{
+    bool rgb565 = false;
+    bool argb1555 = false;
+    bool argb4444 = false;
+};
+
+NativeFormats native_formats(smlt::Renderer *renderer);
+
+/* Offset of (x, y) in a twiddled width x height layout. Squares of the
+ * smaller dimension are Morton ordered, with y in the lowest bit, and laid
+ * out one after another along the larger dimension. Both dimensions must be
+ * powers of two no larger than 1024. */
+uint32_t twiddled_offset(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+/* Reorder 16-bit texels between row order and twiddled order */
+void twiddle(const uint16_t *source, uint16_t *dest, uint16_t width, uint16_t height);
+void untwiddle(const uint16_t *source, uint16_t *dest, uint16_t width, uint16_t height);
+
+/* True for the 565, ARGB4444 and ARGB1555 formats and their twiddled and VQ
+ * variants, which all share a texel layout, and for RGBA4444 and RGBA5551 */
+bool is_packed_format(smlt::TextureFormat format);
+
+/* Packs a single RGBA8888 texel to format's texel layout, rounding to
+ * nearest */
+uint16_t pack_texel(const uint8_t *rgba, smlt::TextureFormat format);
+void unpack_texel(uint16_t texel, smlt::TextureFormat format, uint8_t *rgba);
+
+/* Packs width x height RGBA8888 texels to any of the 16-bit formats: 565,
+ * ARGB4444 or ARGB1555, twiddled or not, or RGBA4444 or RGBA5551. Colour
+ * channels are dithered with a 4x4 Bayer matrix if dither is set; alpha is
+ * always rounded, so cut-out edges stay clean. Returns false for any other
+ * format. */
+bool pack(
+    const uint8_t *rgba,
+    uint16_t width,
+    uint16_t height,
+    smlt::TextureFormat format,
+    bool dither,
+    uint16_t *dest);
+
+/* The format RGBA8888 texels should be converted to: twiddled 565, 1555 or
+ * 4444 depending on how the texels use alpha, when that is one of formats.
+ * Returns TEXTURE_FORMAT_INVALID when the data should be left alone, which is
+ * the case for desktop GPUs. */
+smlt::TextureFormat choose_format(const NativeFormats &formats, const uint8_t *rgba, uint32_t texel_count);
+
+/* Picks a format with choose_format() and packs the data to it. Safe to call
+ * from a worker thread, as it only touches the data passed in. The result's
+ * format is TEXTURE_FORMAT_INVALID if no conversion is needed or the
+ * dimensions can't be twiddled. */
+Conversion convert(const NativeFormats &formats, const std::vector<uint8_t> &rgba, uint16_t width, uint16_t height, bool dither = true);
+
+/* Packs a width x height test pattern to format runs times and returns the
+ * throughput in MB/s of RGBA8888 input */
+float measure_throughput(smlt::TextureFormat format, bool dither, uint16_t width = 256, uint16_t height = 256, uint32_t runs = 8);
+
+} // namespace texture_converter
@@ -0,0 +1,373 @@
+#include "texture_mipmaps.h"
+#include "texture_converter.h"
+
+#include <algorithm>
+#include <math.h>
+
+using namespace smlt;
+
+namespace texture_mipmaps
+{
+
+namespace
+{
+
+const float PI = 3.14159265358979323846f;
+
+const uint32_t LINEAR_TO_SRGB_STEPS = 4096;
+
+/* Kaiser window shape and the filter's reach either side of a destination
+ * texel centre, in destination texels */
+const float KAISER_ALPHA = 4.0f;
+const float KAISER_RADIUS = 1.5f;
+
+/* Coverage rescaling searches for a scale in this range */
+const float MAX_COVERAGE_SCALE = 8.0f;
+const uint32_t COVERAGE_SEARCH_STEPS = 12;
+
+const std::vector<float> &srgb_to_linear_table()
+{
+    static const std::vector<float> table = []() {
+        std::vector<float> ret(256);
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            float c = i / 255.0f;
+            ret[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return ret;
+    }();
+    return table;
+}
+
+const std::vector<uint8_t> &linear_to_srgb_table()
+{
+    static const std::vector<uint8_t> table = []() {
+        std::vector<uint8_t> ret(LINEAR_TO_SRGB_STEPS);
+        for (uint32_t i = 0; i < LINEAR_TO_SRGB_STEPS; ++i)
+        {
+            float c = float(i) / (LINEAR_TO_SRGB_STEPS - 1);
+            float s = (c <= 0.0031308f) ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+            ret[i] = uint8_t(s * 255.0f + 0.5f);
+        }
+        return ret;
+    }();
+    return table;
+}
+
+float clamp01(float value)
+{
+    return std::min(std::max(value, 0.0f), 1.0f);
+}
+
+/* Zeroth order modified Bessel function of the first kind */
+float bessel_i0(float x)
+{
+    float sum = 1.0f;
+    float term = 1.0f;
+    for (uint32_t k = 1; k < 16; ++k)
+    {
+        float t = x / (2.0f * k);
+        term *= t * t;
+        sum += term;
+    }
+    return sum;
+}
+
+struct Tap
+{
+    int32_t offset; // From source texel 2x
+    float weight;
+};
+
+/* Taps for halving a dimension. A destination texel's centre falls between
+ * source texels 2x and 2x + 1, so the same weights apply to every texel. */
+std::vector<Tap> build_taps(Filter filter)
+{
+    if (filter == FILTER_BOX)
+    {
+        return {{0, 0.5f}, {1, 0.5f}};
+    }
+
+    std::vector<Tap> taps;
+    float total = 0.0f;
+    int32_t reach = int32_t(ceilf(KAISER_RADIUS * 2.0f - 0.5f));
+    for (int32_t offset = 1 - reach; offset <= reach; ++offset)
+    {
+        float d = (offset - 0.5f) / 2.0f;
+        float r = d / KAISER_RADIUS;
+        float sinc = sinf(PI * d) / (PI * d);
+        float window = bessel_i0(KAISER_ALPHA * sqrtf(std::max(1.0f - r * r, 0.0f))) / bessel_i0(KAISER_ALPHA);
+        taps.push_back({offset, sinc * window});
+        total += sinc * window;
+    }
+
+    for (auto &tap : taps)
+    {
+        tap.weight /= total;
+    }
+    return taps;
+}
+
+int32_t source_index(int32_t i, int32_t size, bool wrap)
+{
+    if (wrap)
+    {
+        return ((i % size) + size) % size;
+    }
+    return std::min(std::max(i, 0), size - 1);
+}
+
+/* Halves one dimension of a premultiplied RGBA float image. The image is
+ * lines lines of size texels, running along rows or down columns. */
+void downsample_axis(
+    const std::vector<float> &source,
+    uint32_t size,
+    uint32_t lines,
+    bool along_rows,
+    const std::vector<Tap> &taps,
+    bool wrap,
+    std::vector<float> &dest)
+{
+    const uint32_t half = size / 2;
+    dest.assign(half * lines * 4, 0.0f);
+
+    for (uint32_t line = 0; line < lines; ++line)
+    {
+        for (uint32_t i = 0; i < half; ++i)
+        {
+            float *out = along_rows ? &dest[(line * half + i) * 4] : &dest[(i * lines + line) * 4];
+            for (auto &tap : taps)
+            {
+                uint32_t s = source_index(int32_t(i * 2) + tap.offset, size, wrap);
+                const float *in = along_rows ? &source[(line * size + s) * 4] : &source[(s * lines + line) * 4];
+                out[0] += in[0] * tap.weight;
+                out[1] += in[1] * tap.weight;
+                out[2] += in[2] * tap.weight;
+                out[3] += in[3] * tap.weight;
+            }
+        }
+    }
+}
+
+/* RGBA8888 to premultiplied RGBA floats, in linear light if gamma_correct */
+std::vector<float> decode(const uint8_t *rgba, uint32_t count, bool gamma_correct)
+{
+    const auto &linear = srgb_to_linear_table();
+
+    std::vector<float> image(count * 4);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const uint8_t *in = rgba + i * 4;
+        float *out = &image[i * 4];
+        float alpha = in[3] / 255.0f;
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            out[c] = (gamma_correct ? linear[in[c]] : in[c] / 255.0f) * alpha;
+        }
+        out[3] = alpha;
+    }
+    return image;
+}
+
+void encode(const std::vector<float> &image, bool gamma_correct, float alpha_scale, std::vector<uint8_t> &rgba)
+{
+    const auto &srgb = linear_to_srgb_table();
+
+    const uint32_t count = image.size() / 4;
+    rgba.resize(count * 4);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const float *in = &image[i * 4];
+        uint8_t *out = &rgba[i * 4];
+
+        /* The Kaiser filter's negative lobes can push alpha below zero */
+        float alpha = clamp01(in[3]);
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            float value = (alpha > 0.0f) ? clamp01(in[c] / alpha) : 0.0f;
+            out[c] = gamma_correct ? srgb[uint32_t(value * (LINEAR_TO_SRGB_STEPS - 1) + 0.5f)] : uint8_t(value * 255.0f + 0.5f);
+        }
+        out[3] = uint8_t(clamp01(alpha * alpha_scale) * 255.0f + 0.5f);
+    }
+}
+
+float scaled_coverage(const std::vector<float> &image, float scale, float cutoff)
+{
+    const uint32_t count = image.size() / 4;
+    uint32_t passed = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        passed += (image[i * 4 + 3] * scale >= cutoff);
+    }
+    return float(passed) / count;
+}
+
+/* The alpha scale at which the image's coverage comes closest to target.
+ * Coverage only grows with the scale, so a bisection finds it. */
+float coverage_scale(const std::vector<float> &image, float target, float cutoff)
+{
+    float low = 0.0f;
+    float high = MAX_COVERAGE_SCALE;
+    for (uint32_t step = 0; step < COVERAGE_SEARCH_STEPS; ++step)
+    {
+        float mid = (low + high) * 0.5f;
+        if (scaled_coverage(image, mid, cutoff) < target)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    /* Coverage moves in steps on small levels, so neither end may hit the
+     * target exactly */
+    float below = scaled_coverage(image, low, cutoff);
+    float above = scaled_coverage(image, high, cutoff);
+    return (target - below < above - target) ? low : high;
+}
+
+bool is_cut_out(const uint8_t *rgba, uint32_t count)
+{
+    bool transparent = false;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint8_t alpha = rgba[i * 4 + 3];
+        if (alpha != 0 && alpha != 255)
+        {
+            return false;
+        }
+        transparent = transparent || alpha == 0;
+    }
+    return transparent;
+}
+
+} // namespace
+
+uint32_t level_count(uint16_t width, uint16_t height)
+{
+    uint32_t count = 1;
+    while (width > 1 || height > 1)
+    {
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+        ++count;
+    }
+    return count;
+}
+
+float alpha_coverage(const uint8_t *rgba, uint32_t count, float cutoff)
+{
+    if (!count)
+    {
+        return 0.0f;
+    }
+
+    uint32_t passed = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        passed += (rgba[i * 4 + 3] / 255.0f >= cutoff);
+    }
+    return float(passed) / count;
+}
+
+std::vector<Level> build_chain(const uint8_t *rgba, uint16_t width, uint16_t height, const Options &options)
+{
+    std::vector<Level> levels;
+    const uint32_t count = uint32_t(width) * height;
+    if (!count)
+    {
+        return levels;
+    }
+
+    Level top;
+    top.width = width;
+    top.height = height;
+    top.data.assign(rgba, rgba + count * 4);
+    levels.push_back(std::move(top));
+
+    bool preserve_coverage = options.preserve_alpha_coverage && is_cut_out(rgba, count);
+    float coverage = preserve_coverage ? alpha_coverage(rgba, count, options.alpha_cutoff) : 0.0f;
+
+    const auto taps = build_taps(options.filter);
+    std::vector<float> image = decode(rgba, count, options.gamma_correct);
+    std::vector<float> scratch;
+
+    while (width > 1 || height > 1)
+    {
+        if (width > 1)
+        {
+            downsample_axis(image, width, height, true, taps, options.wrap, scratch);
+            image.swap(scratch);
+            width /= 2;
+        }
+
+        if (height > 1)
+        {
+            downsample_axis(image, height, width, false, taps, options.wrap, scratch);
+            image.swap(scratch);
+            height /= 2;
+        }
+
+        float alpha_scale = preserve_coverage ? coverage_scale(image, coverage, options.alpha_cutoff) : 1.0f;
+
+        Level level;
+        level.width = width;
+        level.height = height;
+        encode(image, options.gamma_correct, alpha_scale, level.data);
+        levels.push_back(std::move(level));
+    }
+
+    return levels;
+}
+
+std::vector<Level> pack_chain(const std::vector<Level> &levels, TextureFormat format, bool dither)
+{
+    std::vector<Level> packed;
+    for (auto &level : levels)
+    {
+        Level out;
+        out.width = level.width;
+        out.height = level.height;
+        out.data.resize(uint32_t(level.width) * level.height * sizeof(uint16_t));
+        if (!texture_converter::pack(&level.data[0], level.width, level.height, format, dither, (uint16_t *)&out.data[0]))
+        {
+            return std::vector<Level>();
+        }
+        packed.push_back(std::move(out));
+    }
+    return packed;
+}
+
+std::vector<Level> build_texture_chain(TexturePtr texture, TextureFormat format, const Options &options)
+{
+    if (texture->format() != TEXTURE_FORMAT_RGBA_4UB_8888 || !texture->has_data())
+    {
+        return std::vector<Level>();
+    }
+
+    auto levels = build_chain(texture->data(), texture->width(), texture->height(), options);
+    if (format == TEXTURE_FORMAT_RGBA_4UB_8888)
+    {
+        return levels;
+    }
+
+    return pack_chain(levels, format, options.dither);
+}
+
+uint32_t level_for_size(const std::vector<Level> &levels, float pixels)
+{
+    uint32_t index = 0;
+    for (uint32_t i = 1; i < levels.size(); ++i)
+    {
+        if (std::max(levels[i].width, levels[i].height) < pixels)
+        {
+            break;
+        }
+        index = i;
+    }
+    return index;
+}
+
+} // namespace texture_mipmaps
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "simulant/simulant.h"
+
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Mipmap chains built on the CPU.
+ *
+ * The engine either leaves a texture without mipmaps or asks the driver to
+ * generate them, and the driver averages the stored sRGB values directly, so
+ * smaller levels come out darker than they should and cut-out foliage thins
+ * away to nothing. These filters decode to linear light, weight colour by
+ * alpha so transparent texels don't bleed their colour in, and can rescale
+ * each level's alpha so as many texels pass the alpha test as at the top.
+ */
+namespace texture_mipmaps
+{
+
+enum Filter
+{
+    /* Averages each 2x2 block. Cheap enough to run on the Dreamcast. */
+    FILTER_BOX,
+
+    /* Kaiser-windowed sinc over 6x6 texels. Keeps more detail in the
+     * smaller levels, with three times as many taps as FILTER_BOX. */
+    FILTER_KAISER
+};
+
+struct Options
+{
+    Filter filter = FILTER_BOX;
+
+    /* Filter in linear light, treating the colour channels as sRGB */
+    bool gamma_correct = true;
+
+    /* Sample across the opposite edge, for textures that tile. Otherwise
+     * the edge texels are repeated. */
+    bool wrap = false;
+
+    /* For cut-out textures, those whose top level alpha is only ever 0 or
+     * 255, scale each level's alpha so the fraction of texels at or above
+     * alpha_cutoff stays the same. Textures with blended alpha are left
+     * alone. */
+    bool preserve_alpha_coverage = true;
+    float alpha_cutoff = 0.5f;
+
+    /* Dither the colour channels when packing to 16-bit formats */
+    bool dither = true;
+};
+
+struct Level
+{
+    uint16_t width = 0;
+    uint16_t height = 0;
+    std::vector<uint8_t> data;
+};
+
+/* Number of levels from width x height down to 1x1, including the top */
+uint32_t level_count(uint16_t width, uint16_t height);
+
+/* Fraction of count RGBA8888 texels whose alpha is at or above cutoff, on a
+ * 0-1 scale */
+float alpha_coverage(const uint8_t *rgba, uint32_t count, float cutoff);
+
+/* Builds the chain of width x height RGBA8888 texels, largest first, down to
+ * 1x1. Each dimension halves until it reaches 1; for odd dimensions the last
+ * row or column only contributes through the filter's edge clamp. Every
+ * level is filtered from the one above it, without requantising between
+ * levels. */
+std::vector<Level> build_chain(const uint8_t *rgba, uint16_t width, uint16_t height, const Options &options = Options());
+
+/* Packs every level of an RGBA8888 chain to one of the 16-bit formats with
+ * texture_converter::pack(). Returns an empty vector if format isn't a
+ * 16-bit format, or a level can't be stored in it (twiddled formats need
+ * power of two dimensions). */
+std::vector<Level> pack_chain(const std::vector<Level> &levels, smlt::TextureFormat format, bool dither = true);
+
+/* Builds a chain for the texture's data, which must be RGBA8888, and packs
+ * it to format if that isn't RGBA8888 too. Returns an empty vector if the
+ * texture has no data to build from. */
+std::vector<Level> build_texture_chain(smlt::TexturePtr texture, smlt::TextureFormat format, const Options &options = Options());
+
+/* The index of the smallest level whose larger dimension covers pixels on
+ * screen, so a texture drawn pixels high or wide is sampled at roughly one
+ * texel per pixel */
+uint32_t level_for_size(const std::vector<Level> &levels, float pixels);
+
+} // namespace texture_mipmaps
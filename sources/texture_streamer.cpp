@@ -0,0 +1,301 @@
+#include "texture_streamer.h"
+
+#include "simulant/loaders/stb_image.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string.h>
+
+using namespace smlt;
+
+namespace texture_streamer
+{
+
+namespace
+{
+
+void upload(TexturePtr texture, TextureFormat format, uint16_t width, uint16_t height, const std::vector<uint8_t> &data)
+{
+    texture->set_format(format);
+    texture->resize(width, height, data.size());
+    texture->set_data(data);
+    if (texture->auto_upload())
+    {
+        texture->flush();
+    }
+}
+
+} // namespace
+
+Decoded decode(const uint8_t *data, std::size_t size, const Settings &settings)
+{
+    Decoded decoded;
+
+    int width, height, channels;
+    stbi_uc *texels = stbi_load_from_memory(data, size, &width, &height, &channels, 4);
+    if (!texels)
+    {
+        return decoded;
+    }
+
+    /* Flip to bottom row first, as the texture loader does, unless asked to
+     * flip back */
+    uint32_t row_size = width * 4;
+    std::vector<uint8_t> rgba(row_size * height);
+    for (int y = 0; y < height; ++y)
+    {
+        int source = settings.flip_vertically ? y : height - 1 - y;
+        memcpy(&rgba[y * row_size], texels + source * row_size, row_size);
+    }
+    stbi_image_free(texels);
+
+    decoded.width = width;
+    decoded.height = height;
+
+    const texture_mipmaps::Options &options = settings.mipmaps;
+    if (settings.levels)
+    {
+        TextureFormat format = texture_converter::choose_format(settings.formats, &rgba[0], uint32_t(width) * height);
+        auto chain = texture_mipmaps::build_chain(&rgba[0], width, height, options);
+
+        decoded.format = TEXTURE_FORMAT_RGBA_4UB_8888;
+        if (format != TEXTURE_FORMAT_INVALID)
+        {
+            decoded.levels = texture_mipmaps::pack_chain(chain, format, options.dither);
+            if (!decoded.levels.empty())
+            {
+                decoded.format = format;
+            }
+        }
+
+        /* Left as RGBA8888 for desktop GPUs, or if the levels can't be
+         * twiddled */
+        if (decoded.levels.empty())
+        {
+            decoded.levels = std::move(chain);
+        }
+        return decoded;
+    }
+
+    auto conversion = texture_converter::convert(settings.formats, rgba, width, height, options.dither);
+
+    if (conversion.format == TEXTURE_FORMAT_INVALID)
+    {
+        decoded.format = TEXTURE_FORMAT_RGBA_4UB_8888;
+        decoded.data = std::move(rgba);
+    }
+    else
+    {
+        decoded.format = conversion.format;
+        decoded.data = std::move(conversion.data);
+    }
+
+    return decoded;
+}
+
+Decoded decode(const std::string &filename, const Settings &settings)
+{
+    std::ifstream stream(filename, std::ios::binary);
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    if (file.empty())
+    {
+        return Decoded();
+    }
+
+    return decode(&file[0], file.size(), settings);
+}
+
+Streamer::Streamer(AssetManager *assets, Renderer *renderer, VirtualFileSystem *vfs, const Config &config)
+    : assets_(assets), vfs_(vfs), config_(config), formats_(texture_converter::native_formats(renderer))
+{
+    uint16_t size = config_.placeholder_size;
+    placeholder_.resize(size * size * 4);
+    for (uint32_t y = 0; y < size; ++y)
+    {
+        for (uint32_t x = 0; x < size; ++x)
+        {
+            const Colour &colour = config_.placeholder_colours[(x + y) % 2];
+            uint8_t *texel = &placeholder_[(y * size + x) * 4];
+            texel[0] = uint8_t(colour.r * 255.0f);
+            texel[1] = uint8_t(colour.g * 255.0f);
+            texel[2] = uint8_t(colour.b * 255.0f);
+            texel[3] = uint8_t(colour.a * 255.0f);
+        }
+    }
+}
+
+TexturePtr Streamer::load(const Path &filename, const TextureFlags &flags)
+{
+    auto path = vfs_->locate_file(filename);
+    if (!path.has_value())
+    {
+        S_WARN("Unable to locate texture {0}", filename.str());
+        return TexturePtr();
+    }
+
+    uint16_t size = config_.placeholder_size;
+    auto texture = assets_->new_texture(size, size, TEXTURE_FORMAT_RGBA_4UB_8888);
+    texture->set_data(placeholder_);
+    texture->set_texture_filter(flags.filter);
+    texture->set_texture_wrap(flags.wrap, flags.wrap, flags.wrap);
+    texture->set_mipmap_generation(flags.mipmap);
+    texture->set_free_data_mode(flags.free_data);
+    texture->set_auto_upload(flags.auto_upload);
+    texture->set_source(path.value());
+
+    std::unique_ptr<Request> request(new Request());
+    request->texture = texture;
+    request->filename = path.value().str();
+
+    Settings settings;
+    settings.formats = formats_;
+    settings.levels = config_.stream_levels;
+    settings.mipmaps = config_.mipmaps;
+    settings.flip_vertically = flags.flip_vertically;
+
+    std::string file = request->filename;
+    request->decoded = worker_thread::shared_worker().submit<Decoded>([file, settings]() {
+        return decode(file, settings);
+    });
+
+    decoding_.push_back(std::move(request));
+    return texture;
+}
+
+void Streamer::update()
+{
+    for (auto it = decoding_.begin(); it != decoding_.end();)
+    {
+        Request &request = **it;
+        if (!request.decoded->is_ready())
+        {
+            ++it;
+            continue;
+        }
+
+        Decoded decoded;
+        if (!request.decoded->is_failed())
+        {
+            decoded = std::move(request.decoded->value());
+        }
+
+        if (decoded.data.empty() && decoded.levels.empty())
+        {
+            S_WARN("Unable to decode texture {0}, keeping the placeholder", request.filename);
+        }
+        else
+        {
+            submit(request.texture, std::move(decoded));
+        }
+
+        it = decoding_.erase(it);
+    }
+
+    uint32_t uploaded = 0;
+    while (!uploads_.empty())
+    {
+        Upload &upload = uploads_.front();
+        uint32_t size = upload.decoded.data.size();
+        if (uploaded && uploaded + size > config_.upload_budget)
+        {
+            break;
+        }
+
+        texture_streamer::upload(upload.texture, upload.decoded.format, upload.decoded.width, upload.decoded.height, upload.decoded.data);
+
+        uploaded += size;
+        uploads_.pop_front();
+    }
+
+    for (auto &streamed : streamed_)
+    {
+        if (streamed.level == streamed.wanted)
+        {
+            continue;
+        }
+
+        const texture_mipmaps::Level &level = streamed.levels[streamed.wanted];
+        uint32_t size = level.data.size();
+        if (uploaded && uploaded + size > config_.upload_budget)
+        {
+            break;
+        }
+
+        texture_streamer::upload(streamed.texture, streamed.format, level.width, level.height, level.data);
+        streamed.level = streamed.wanted;
+        uploaded += size;
+    }
+}
+
+void Streamer::submit(TexturePtr texture, Decoded decoded)
+{
+    if (decoded.levels.empty())
+    {
+        uploads_.push_back(Upload{texture, std::move(decoded)});
+        return;
+    }
+
+    /* Nothing is uploaded yet, so level is one past the end */
+    uint32_t base = 0;
+    while (base + 1 < decoded.levels.size() &&
+           std::max(decoded.levels[base].width, decoded.levels[base].height) > config_.stream_base_size)
+    {
+        ++base;
+    }
+
+    uint32_t count = decoded.levels.size();
+    streamed_.push_back(Streamed{texture, decoded.format, std::move(decoded.levels), count, base});
+}
+
+void Streamer::request_size(TexturePtr texture, float pixels)
+{
+    Streamed *streamed = find_streamed(texture);
+    if (!streamed)
+    {
+        return;
+    }
+
+    uint32_t wanted = texture_mipmaps::level_for_size(streamed->levels, pixels);
+    if (wanted < streamed->level || wanted >= streamed->level + 2)
+    {
+        streamed->wanted = wanted;
+    }
+    else
+    {
+        streamed->wanted = streamed->level;
+    }
+}
+
+void Streamer::release(TexturePtr texture)
+{
+    /* The worker still finishes a decode in flight, but its result has no
+     * request left to land in */
+    decoding_.remove_if([texture](const std::unique_ptr<Request> &request) { return request->texture == texture; });
+    uploads_.remove_if([texture](const Upload &upload) { return upload.texture == texture; });
+    streamed_.remove_if([texture](const Streamed &streamed) { return streamed.texture == texture; });
+}
+
+std::size_t Streamer::pending() const
+{
+    std::size_t count = decoding_.size() + uploads_.size();
+    for (auto &streamed : streamed_)
+    {
+        count += (streamed.level != streamed.wanted);
+    }
+    return count;
+}
+
+Streamer::Streamed *Streamer::find_streamed(TexturePtr texture)
+{
+    for (auto &streamed : streamed_)
+    {
+        if (streamed.texture == texture)
+        {
+            return &streamed;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace texture_streamer
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "simulant/simulant.h"
+
+#include "texture_converter.h"
+#include "texture_mipmaps.h"
+#include "worker_thread.h"
+
+#include <list>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Background texture loading.
+ *
+ * AssetManager::new_texture_from_file() decodes on the main thread, and the
+ * renderer uploads the texture inside the frame it's first drawn, so loading
+ * an area's textures hitches for several frames. The streamer hands back a
+ * texture showing a placeholder straight away, decodes and converts the file
+ * on the shared worker thread, then swaps the real data in from update() with
+ * no more than a set number of bytes uploaded per frame.
+ *
+ * With stream_levels set, the worker also builds the texture's mipmap chain,
+ * and only a small level is uploaded to begin with. Larger levels follow as
+ * request_size() asks for them, and smaller ones replace them again when the
+ * texture shrinks on screen, which keeps distant textures out of video
+ * memory. The chain stays in main memory, about a third more than the top
+ * level alone, until release() is called.
+ */
+namespace texture_streamer
+{
+
+struct Config
+{
+    /* Bytes of texture data uploaded per frame. One texture is always
+     * uploaded per frame, however large, so nothing waits forever. */
+    uint32_t upload_budget = 256 * 1024;
+
+    /* Shown until the real texture lands, as a checkerboard of
+     * placeholder_size x placeholder_size texels */
+    uint16_t placeholder_size = 8;
+    smlt::Colour placeholder_colours[2] = {smlt::Colour(1.0f, 0.0f, 1.0f, 1.0f), smlt::Colour(0.2f, 0.2f, 0.2f, 1.0f)};
+
+    /* Upload the largest level no bigger than stream_base_size first, and
+     * larger levels only when request_size() needs them */
+    bool stream_levels = false;
+    uint16_t stream_base_size = 32;
+
+    /* How levels are built when streaming. mipmaps.dither also controls
+     * dithering when converting to the renderer's native 16-bit formats,
+     * streamed or not. */
+    texture_mipmaps::Options mipmaps;
+};
+
+struct Decoded
+{
+    uint16_t width = 0;
+    uint16_t height = 0;
+    smlt::TextureFormat format = smlt::TEXTURE_FORMAT_INVALID;
+    std::vector<uint8_t> data;
+
+    /* The mipmap chain, largest first, in format. Set instead of data when
+     * decoding with mipmaps. */
+    std::vector<texture_mipmaps::Level> levels;
+};
+
+/* How decode() treats the data. Plain data only, so a copy can go to a worker
+ * thread. */
+struct Settings
+{
+    /* Converted to with texture_converter::convert(). The default leaves the
+     * data as RGBA8888. */
+    texture_converter::NativeFormats formats;
+
+    /* Build the whole mipmap chain with mipmaps and convert that instead.
+     * mipmaps.dither applies either way. */
+    bool levels = false;
+    texture_mipmaps::Options mipmaps;
+
+    /* Leave the rows top first, as TextureFlags::flip_vertically does */
+    bool flip_vertically = false;
+};
+
+/* Decodes PNG, TGA or JPEG data to RGBA8888, bottom row first as the
+ * engine's texture loader stores it, then converts it as settings ask.
+ * Returns an empty result on failure. Safe to call from a worker thread. */
+Decoded decode(const uint8_t *data, std::size_t size, const Settings &settings);
+
+/* Reads filename and decodes it as above */
+Decoded decode(const std::string &filename, const Settings &settings);
+
+class Streamer
+{
+public:
+    Streamer(smlt::AssetManager *assets, smlt::Renderer *renderer, smlt::VirtualFileSystem *vfs, const Config &config = Config());
+
+    /* Returns a texture showing the placeholder, or an empty pointer if the
+     * file can't be found. The file is decoded on a worker thread. flags
+     * apply as they do to AssetManager::new_texture_from_file(); with
+     * auto_upload off, update() sets the data but leaves the upload to the
+     * caller. */
+    smlt::TexturePtr load(const smlt::Path &filename, const smlt::TextureFlags &flags = smlt::TextureFlags());
+
+    /* Picks up finished decodes and uploads them, oldest first, until the
+     * frame's budget is spent. Call once per frame from the main thread. */
+    void update();
+
+    /* Queues data decoded elsewhere for upload to texture, as if load() had
+     * decoded it. Data with levels is streamed. */
+    void submit(smlt::TexturePtr texture, Decoded decoded);
+
+    /* Asks for the level of a streamed texture that covers pixels on screen,
+     * such as detail_level_selector::projected_size() of the geometry it's
+     * drawn on. Larger levels are uploaded as soon as the budget allows; a
+     * smaller one only replaces the current level once it is two levels
+     * down, so a texture on a boundary doesn't swap back and forth. */
+    void request_size(smlt::TexturePtr texture, float pixels);
+
+    /* Stops loading or streaming the texture. A decode still in flight is
+     * discarded, a queued upload dropped and a streamed chain freed; the
+     * texture keeps whatever it shows now. */
+    void release(smlt::TexturePtr texture);
+
+    /* Textures still decoding or waiting for upload */
+    std::size_t pending() const;
+
+private:
+    struct Request
+    {
+        smlt::TexturePtr texture;
+        std::string filename;
+        worker_thread::ResultPtr<Decoded> decoded;
+    };
+
+    struct Upload
+    {
+        smlt::TexturePtr texture;
+        Decoded decoded;
+    };
+
+    struct Streamed
+    {
+        smlt::TexturePtr texture;
+        smlt::TextureFormat format;
+        std::vector<texture_mipmaps::Level> levels;
+        uint32_t level; // Uploaded
+        uint32_t wanted;
+    };
+
+    smlt::AssetManager *assets_;
+    smlt::VirtualFileSystem *vfs_;
+    Config config_;
+
+    /* Asked of the renderer up front, as the worker mustn't touch it */
+    texture_converter::NativeFormats formats_;
+
+    std::vector<uint8_t> placeholder_;
+
+    std::list<std::unique_ptr<Request>> decoding_;
+    std::list<Upload> uploads_;
+    std::list<Streamed> streamed_;
+
+    Streamed *find_streamed(smlt::TexturePtr texture);
+};
+
+} // namespace texture_streamer
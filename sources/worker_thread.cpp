@@ -0,0 +1,73 @@
+#include "worker_thread.h"
+
+using namespace smlt;
+
+namespace worker_thread
+{
+
+Worker::~Worker()
+{
+    {
+        thread::Lock<thread::Mutex> lock(mutex_);
+        stopping_ = true;
+        jobs_.clear();
+    }
+    condition_.notify_all();
+
+    if (thread_ && thread_->joinable())
+    {
+        thread_->join();
+    }
+}
+
+std::size_t Worker::queued() const
+{
+    thread::Lock<thread::Mutex> lock(mutex_);
+    return jobs_.size();
+}
+
+void Worker::push(std::function<void()> job)
+{
+    {
+        thread::Lock<thread::Mutex> lock(mutex_);
+        jobs_.push_back(std::move(job));
+        if (!thread_)
+        {
+            thread_.reset(new thread::Thread(&Worker::run, this));
+        }
+    }
+    condition_.notify_one();
+}
+
+void Worker::run()
+{
+    while (true)
+    {
+        std::function<void()> job;
+        {
+            thread::Lock<thread::Mutex> lock(mutex_);
+            while (jobs_.empty() && !stopping_)
+            {
+                condition_.wait(mutex_);
+            }
+
+            if (stopping_)
+            {
+                return;
+            }
+
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        job();
+    }
+}
+
+Worker &shared_worker()
+{
+    static Worker worker;
+    return worker;
+}
+
+} // namespace worker_thread
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "simulant/simulant.h"
+#include "simulant/threads/condition.h"
+#include "simulant/threads/thread.h"
+
+#include <deque>
+#include <functional>
+#include <memory>
+
+/*
+ * A single background thread fed by a queue.
+ *
+ * thread::async() starts and detaches a new thread for every call, so
+ * loading a level's worth of textures would start dozens of threads on the
+ * Dreamcast's single core. Background work goes through one worker instead,
+ * which runs jobs in the order they were submitted.
+ */
+namespace worker_thread
+{
+
+/* The outcome of a submitted job, filled in by the worker thread */
+template <typename T>
+class Result
+{
+public:
+    bool is_ready() const
+    {
+        smlt::thread::Lock<smlt::thread::Mutex> lock(mutex_);
+        return ready_;
+    }
+
+    /* True if the job threw. Only meaningful once is_ready(). */
+    bool is_failed() const
+    {
+        smlt::thread::Lock<smlt::thread::Mutex> lock(mutex_);
+        return failed_;
+    }
+
+    /* The job's return value. Only valid once is_ready() and not
+     * is_failed(). */
+    T &value() { return value_; }
+
+private:
+    friend class Worker;
+
+    mutable smlt::thread::Mutex mutex_;
+    bool ready_ = false;
+    bool failed_ = false;
+    T value_;
+};
+
+template <typename T>
+using ResultPtr = std::shared_ptr<Result<T>>;
+
+class Worker
+{
+public:
+    Worker() = default;
+    Worker(const Worker &) = delete;
+    Worker &operator=(const Worker &) = delete;
+
+    /* Finishes the running job, drops any still queued and joins the
+     * thread */
+    ~Worker();
+
+    /* Queues job to run on the worker thread, starting the thread if this
+     * is the first job. job must only touch data it owns or that outlives
+     * it. */
+    template <typename T>
+    ResultPtr<T> submit(std::function<T()> job)
+    {
+        auto result = std::make_shared<Result<T>>();
+        push([result, job]() {
+            bool failed = false;
+            T value;
+            try
+            {
+                value = job();
+            }
+            catch (...)
+            {
+                failed = true;
+            }
+
+            smlt::thread::Lock<smlt::thread::Mutex> lock(result->mutex_);
+            result->value_ = std::move(value);
+            result->failed_ = failed;
+            result->ready_ = true;
+        });
+        return result;
+    }
+
+    /* Jobs submitted but not yet started */
+    std::size_t queued() const;
+
+private:
+    mutable smlt::thread::Mutex mutex_;
+    smlt::thread::Condition condition_;
+    std::deque<std::function<void()>> jobs_;
+    bool stopping_ = false;
+
+    std::unique_ptr<smlt::thread::Thread> thread_;
+
+    void push(std::function<void()> job);
+    void run();
+};
+
+/* The worker shared by the game's background loading, so that everything
+ * queues on one thread */
+Worker &shared_worker();
+
+} // namespace worker_thread
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "simulant/test.h"
+#include "../sources/detail_level_selector.h"
+
+#include <array>
+#include <float.h>
+
+namespace {
+
+using namespace smlt;
+
+class DetailLevelSelectorTestCase : public test::SimulantTestCase {
+public:
+  /* A mesh that draws triangles copies of one small triangle */
+  MeshPtr triangles(uint32_t count) {
+    auto mesh = application->shared_assets->new_mesh(VertexSpecification::DEFAULT);
+    mesh->vertex_data->position(0.0f, 0.0f, 0.0f);
+    mesh->vertex_data->move_next();
+    mesh->vertex_data->position(1.0f, 0.0f, 0.0f);
+    mesh->vertex_data->move_next();
+    mesh->vertex_data->position(0.0f, 1.0f, 0.0f);
+    mesh->vertex_data->move_next();
+    mesh->vertex_data->done();
+
+    auto submesh = mesh->new_submesh("triangles", application->shared_assets->new_material()->id(), INDEX_TYPE_16_BIT);
+    for(uint32_t i = 0; i < count * 3; ++i) {
+      submesh->index_data->index(i % 3);
+    }
+    submesh->index_data->done();
+    return mesh;
+  }
+
+  std::array<MeshPtr, DETAIL_LEVEL_MAX> levels(uint32_t nearest) {
+    std::array<MeshPtr, DETAIL_LEVEL_MAX> meshes;
+    for(uint32_t i = 0; i < DETAIL_LEVEL_MAX; ++i) {
+      meshes[i] = triangles(nearest >> i);
+    }
+    return meshes;
+  }
+
+  /* A camera at the origin looking down -Z */
+  CameraPtr camera(StagePtr stage) {
+    auto camera = stage->new_camera();
+    camera->set_perspective_projection(Degrees(45), 4.0f / 3.0f, 0.1f, 1000.0f);
+    camera->frustum().build(&camera->projection_matrix());
+    return camera;
+  }
+
+  /* Thresholds that keep everything at DETAIL_LEVEL_NEAREST on screen size,
+   * so only the budget changes levels */
+  detail_level_selector::Thresholds nearest_only() {
+    detail_level_selector::Thresholds thresholds;
+    for(auto& pixels: thresholds.pixels) {
+      pixels = 0.0f;
+    }
+    return thresholds;
+  }
+
+  void test_budget_demotes_largest_first() {
+    auto stage = scene->new_stage(PARTITIONER_NULL);
+    auto cam = camera(stage);
+
+    auto tank_meshes = levels(1024);
+    auto bolt_meshes = levels(16);
+    auto tank = stage->new_actor_with_mesh(tank_meshes[0]);
+    auto bolt = stage->new_actor_with_mesh(bolt_meshes[0]);
+    tank->move_to(0, 0, -50);
+    bolt->move_to(0, 0, -60);
+
+    detail_level_selector::Selector selector(nearest_only());
+    selector.add(tank, tank_meshes);
+    selector.add(bolt, bolt_meshes);
+    selector.set_triangle_budget(1024);
+
+    /* The bolt is farther, but demoting it wouldn't cover the excess */
+    selector.update(cam, 480, 1040);
+    assert_equal(tank_meshes[DETAIL_LEVEL_NEAR]->id(), tank->mesh(DETAIL_LEVEL_NEAREST)->id());
+    assert_equal(bolt_meshes[DETAIL_LEVEL_NEAREST]->id(), bolt->mesh(DETAIL_LEVEL_NEAREST)->id());
+
+    stage->destroy();
+  }
+
+  void test_budget_restores_when_it_fits() {
+    auto stage = scene->new_stage(PARTITIONER_NULL);
+    auto cam = camera(stage);
+
+    auto meshes = levels(1024);
+    auto actor = stage->new_actor_with_mesh(meshes[0]);
+    actor->move_to(0, 0, -50);
+
+    detail_level_selector::Selector selector(nearest_only());
+    selector.add(actor, meshes);
+    selector.set_triangle_budget(1000);
+
+    selector.update(cam, 480, 1024);
+    assert_equal(meshes[DETAIL_LEVEL_NEAR]->id(), actor->mesh(DETAIL_LEVEL_NEAREST)->id());
+
+    /* Restoring would put it straight back over */
+    selector.update(cam, 480, 512);
+    assert_equal(meshes[DETAIL_LEVEL_NEAR]->id(), actor->mesh(DETAIL_LEVEL_NEAREST)->id());
+
+    selector.set_triangle_budget(2000);
+    selector.update(cam, 480, 512);
+    assert_equal(meshes[DETAIL_LEVEL_NEAREST]->id(), actor->mesh(DETAIL_LEVEL_NEAREST)->id());
+
+    stage->destroy();
+  }
+
+  void test_budget_ignores_hidden() {
+    auto stage = scene->new_stage(PARTITIONER_NULL);
+    auto cam = camera(stage);
+
+    auto behind_meshes = levels(1024);
+    auto ahead_meshes = levels(16);
+    auto behind = stage->new_actor_with_mesh(behind_meshes[0]);
+    auto ahead = stage->new_actor_with_mesh(ahead_meshes[0]);
+    behind->move_to(0, 0, 50);
+    ahead->move_to(0, 0, -50);
+
+    detail_level_selector::Selector selector(nearest_only());
+    selector.add(behind, behind_meshes);
+    selector.add(ahead, ahead_meshes);
+    selector.set_triangle_budget(1024);
+
+    /* Last frame drew both, but the one behind the camera drops out of this
+     * frame's count, so nothing needs demoting */
+    selector.update(cam, 480, 1040);
+    assert_equal(behind_meshes[DETAIL_LEVEL_NEAREST]->id(), behind->mesh(DETAIL_LEVEL_NEAREST)->id());
+    assert_equal(ahead_meshes[DETAIL_LEVEL_NEAREST]->id(), ahead->mesh(DETAIL_LEVEL_NEAREST)->id());
+
+    stage->destroy();
+  }
+
+  void test_destroyed_actor_is_removed() {
+    auto stage = scene->new_stage(PARTITIONER_NULL);
+    auto cam = camera(stage);
+
+    auto meshes = levels(64);
+    auto actor = stage->new_actor_with_mesh(meshes[0]);
+
+    detail_level_selector::Selector selector(nearest_only());
+    selector.add(actor, meshes);
+    selector.set_triangle_budget(16);
+
+    actor->destroy_immediately();
+    selector.update(cam, 480, 64);
+
+    stage->destroy();
+  }
+
+  void test_projected_size_falls_with_distance() {
+    Mat4 projection = Mat4::as_projection(Degrees(45), 4.0f / 3.0f, 0.1f, 100.0f);
+    AABB bounds(Vec3(0, 0, -10), 1.0f);
+
+    float near = detail_level_selector::projected_size(bounds, Vec3(), projection, 480);
+    float far = detail_level_selector::projected_size(AABB(Vec3(0, 0, -20), 1.0f), Vec3(), projection, 480);
+
+    assert_true(near > 0.0f);
+    assert_close(0.5f, far / near, 0.01f);
+  }
+
+  void test_projected_size_inside_bounds() {
+    Mat4 projection = Mat4::as_projection(Degrees(45), 4.0f / 3.0f, 0.1f, 100.0f);
+    AABB bounds(Vec3(), 4.0f);
+
+    assert_equal(FLT_MAX, detail_level_selector::projected_size(bounds, Vec3(0, 0, 1), projection, 480));
+  }
+
+  void test_select_detail_level() {
+    detail_level_selector::Thresholds thresholds;
+
+    assert_equal(DETAIL_LEVEL_NEAREST, detail_level_selector::select_detail_level(1000.0f, DETAIL_LEVEL_FARTHEST, thresholds));
+    assert_equal(DETAIL_LEVEL_MID, detail_level_selector::select_detail_level(90.0f, DETAIL_LEVEL_MID, thresholds));
+    assert_equal(DETAIL_LEVEL_FARTHEST, detail_level_selector::select_detail_level(1.0f, DETAIL_LEVEL_NEAREST, thresholds));
+  }
+
+  void test_hysteresis() {
+    detail_level_selector::Thresholds thresholds;
+    float threshold = thresholds.pixels[DETAIL_LEVEL_NEAR];
+
+    /* Just either side of the threshold, the current level sticks */
+    assert_equal(DETAIL_LEVEL_MID, detail_level_selector::select_detail_level(threshold * 1.05f, DETAIL_LEVEL_MID, thresholds));
+    assert_equal(DETAIL_LEVEL_NEAR, detail_level_selector::select_detail_level(threshold * 0.95f, DETAIL_LEVEL_NEAR, thresholds));
+
+    /* Past the band, it changes */
+    assert_equal(DETAIL_LEVEL_NEAR, detail_level_selector::select_detail_level(threshold * 1.2f, DETAIL_LEVEL_MID, thresholds));
+    assert_equal(DETAIL_LEVEL_MID, detail_level_selector::select_detail_level(threshold * 0.8f, DETAIL_LEVEL_NEAR, thresholds));
+  }
+};
+
+}
@@ -0,0 +1,287 @@
+#pragma once
+
+#include "simulant/test.h"
+#include "../sources/mesh_optimiser.h"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <random>
+
+namespace {
+
+using namespace smlt;
+
+class MeshOptimiserTestCase : public test::SimulantTestCase {
+public:
+  /* A size x size grid of quads with its triangles shuffled, which is about as
+   * cache-hostile as file order gets */
+  std::vector<uint32_t> shuffled_grid(uint32_t size) {
+    std::vector<std::array<uint32_t, 3>> triangles;
+    for(uint32_t y = 0; y < size; ++y) {
+      for(uint32_t x = 0; x < size; ++x) {
+        uint32_t a = y * (size + 1) + x;
+        uint32_t c = a + size + 1;
+        triangles.push_back({{a, c, a + 1}});
+        triangles.push_back({{a + 1, c, c + 1}});
+      }
+    }
+
+    std::mt19937 rng(1);
+    std::shuffle(triangles.begin(), triangles.end(), rng);
+
+    std::vector<uint32_t> indices;
+    for(auto& tri: triangles) {
+      indices.insert(indices.end(), tri.begin(), tri.end());
+    }
+    return indices;
+  }
+
+  void test_acmr() {
+    std::vector<uint32_t> indices = {0, 1, 2, 2, 1, 3};
+    assert_close(2.0f, mesh_optimiser::calculate_acmr(indices), 0.0001f);
+
+    indices = {0, 1, 2, 3, 4, 5};
+    assert_close(3.0f, mesh_optimiser::calculate_acmr(indices), 0.0001f);
+  }
+
+  void test_vertex_cache_reduces_acmr() {
+    auto indices = shuffled_grid(32);
+    auto before = mesh_optimiser::calculate_acmr(indices);
+
+    mesh_optimiser::optimise_vertex_cache(indices, 33 * 33);
+
+    assert_true(mesh_optimiser::calculate_acmr(indices) < before * 0.5f);
+  }
+
+  /* Reports the cache pass on the meshes the game loads. sample_data isn't
+   * checked in, so this is skipped where it hasn't been copied alongside. */
+  void test_sample_mesh_acmr() {
+    const std::vector<std::string> samples = {"sample_data/tank.obj"};
+    for(auto& sample: samples) {
+      skip_if(!application->vfs->locate_file(sample, true, true), sample + " isn't available");
+
+      auto mesh = application->shared_assets->new_mesh_from_file(sample);
+      auto report = mesh_optimiser::optimise_mesh(mesh);
+      std::cout << sample << " (" << report.triangles << " triangles): ACMR "
+                << report.acmr_before << " -> " << report.acmr_after << std::endl;
+
+      assert_true(report.acmr_after <= report.acmr_before);
+    }
+  }
+
+  void test_vertex_cache_keeps_triangles() {
+    auto indices = shuffled_grid(8);
+    auto original = indices;
+
+    mesh_optimiser::optimise_vertex_cache(indices, 9 * 9);
+
+    auto triangles = [](const std::vector<uint32_t>& idx) {
+      std::vector<std::array<uint32_t, 3>> ret;
+      for(std::size_t i = 0; i < idx.size(); i += 3) {
+        ret.push_back({{idx[i], idx[i + 1], idx[i + 2]}});
+      }
+      std::sort(ret.begin(), ret.end());
+      return ret;
+    };
+
+    assert_equal(original.size(), indices.size());
+    assert_true(triangles(original) == triangles(indices));
+  }
+
+  /* Expands a strip back into its non-degenerate triangles, each rotated so
+   * the smallest index comes first */
+  std::vector<std::array<uint32_t, 3>> strip_triangles(const std::vector<uint32_t>& strip) {
+    std::vector<std::array<uint32_t, 3>> ret;
+    for(std::size_t i = 0; i + 2 < strip.size(); ++i) {
+      uint32_t a = strip[i], b = strip[i + 1], c = strip[i + 2];
+      if(a == b || b == c || a == c) {
+        continue;
+      }
+
+      std::array<uint32_t, 3> tri = (i % 2 == 0) ? std::array<uint32_t, 3>{{a, b, c}} : std::array<uint32_t, 3>{{b, a, c}};
+      while(tri[0] > tri[1] || tri[0] > tri[2]) {
+        std::rotate(tri.begin(), tri.begin() + 1, tri.end());
+      }
+      ret.push_back(tri);
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+  }
+
+  void test_smallest_index_type() {
+    assert_equal(INDEX_TYPE_8_BIT, mesh_optimiser::smallest_index_type(255));
+    assert_equal(INDEX_TYPE_16_BIT, mesh_optimiser::smallest_index_type(256));
+    assert_equal(INDEX_TYPE_16_BIT, mesh_optimiser::smallest_index_type(65535));
+    assert_equal(INDEX_TYPE_32_BIT, mesh_optimiser::smallest_index_type(65536));
+  }
+
+  void test_stripify_preserves_winding() {
+    auto list = shuffled_grid(16);
+    mesh_optimiser::optimise_vertex_cache(list, 17 * 17);
+
+    auto strip = mesh_optimiser::stripify(list);
+
+    /* Each list triangle on its own is a one-triangle strip, which gives the
+     * canonical form to compare against */
+    std::vector<std::array<uint32_t, 3>> expected;
+    for(std::size_t i = 0; i < list.size(); i += 3) {
+      expected.push_back(strip_triangles({list[i], list[i + 1], list[i + 2]})[0]);
+    }
+    std::sort(expected.begin(), expected.end());
+
+    assert_true(strip.size() < list.size());
+    assert_true(strip_triangles(strip) == expected);
+  }
+
+  void test_vertex_fetch_remap() {
+    std::vector<uint32_t> first = {4, 2, 0};
+    std::vector<uint32_t> second = {0, 2, 3};
+    std::vector<std::vector<uint32_t>*> lists = {&first, &second};
+
+    auto remap = mesh_optimiser::optimise_vertex_fetch(lists, 5);
+
+    assert_equal(0u, first[0]);
+    assert_equal(1u, first[1]);
+    assert_equal(2u, first[2]);
+    assert_equal(2u, second[0]);
+    assert_equal(3u, second[2]);
+
+    /* Vertex 1 is never referenced so is moved to the end */
+    assert_equal(4u, remap[1]);
+  }
+
+  /* A 300 vertex mesh, vertex i at x = i. The 16-bit submesh uses vertices
+   * 100-299 and the 8-bit one 0-99, so numbering vertices in order of first
+   * use would push the 8-bit submesh's indices past 255. */
+  MeshPtr mixed_index_mesh() {
+    auto mesh = application->shared_assets->new_mesh(VertexSpecification::DEFAULT);
+    for(uint32_t i = 0; i < 300; ++i) {
+      mesh->vertex_data->position(float(i), 0.0f, 0.0f);
+      mesh->vertex_data->move_next();
+    }
+    mesh->vertex_data->done();
+
+    auto material = application->shared_assets->new_material();
+    auto wide = mesh->new_submesh("wide", material->id(), INDEX_TYPE_16_BIT);
+    for(uint32_t i = 100; i < 297; ++i) {
+      wide->index_data->index(i);
+    }
+    wide->index_data->done();
+
+    auto narrow = mesh->new_submesh("narrow", material->id(), INDEX_TYPE_8_BIT);
+    for(uint32_t i = 0; i < 99; ++i) {
+      narrow->index_data->index(i);
+    }
+    narrow->index_data->done();
+    return mesh;
+  }
+
+  void test_vertex_fetch_respects_index_type() {
+    auto mesh = mixed_index_mesh();
+    mesh_optimiser::optimise_mesh(mesh);
+
+    auto narrow = mesh->find_submesh("narrow");
+    assert_equal(INDEX_TYPE_8_BIT, narrow->index_data->index_type());
+    for(uint32_t i = 0; i < narrow->index_data->count(); ++i) {
+      uint32_t index = narrow->index_data->at(i);
+      assert_true(mesh->vertex_data->position_at<Vec3>(index)->x < 100.0f);
+    }
+  }
+
+  void test_vertex_fetch_skips_shared_vertex_data() {
+    auto mesh = mixed_index_mesh();
+    mesh->destroy_submesh("narrow");
+    auto other = application->shared_assets->new_mesh(mesh->vertex_data->shared_from_this());
+
+    mesh_optimiser::optimise_mesh(mesh);
+
+    for(uint32_t i = 0; i < 300; ++i) {
+      assert_equal(float(i), other->vertex_data->position_at<Vec3>(i)->x);
+    }
+  }
+
+  void test_vertex_fetch_renumbers_strips() {
+    auto mesh = application->shared_assets->new_mesh(VertexSpecification::DEFAULT);
+    for(uint32_t i = 0; i < 25; ++i) {
+      mesh->vertex_data->position(float(i), 0.0f, 0.0f);
+      mesh->vertex_data->move_next();
+    }
+    mesh->vertex_data->done();
+
+    auto material = application->shared_assets->new_material();
+    auto list = mesh->new_submesh("list", material->id(), INDEX_TYPE_16_BIT);
+    for(auto index: shuffled_grid(4)) {
+      list->index_data->index(index);
+    }
+    list->index_data->done();
+
+    const std::vector<uint32_t> strip_indices = {24, 3, 17, 8, 12, 0};
+    auto strip = mesh->new_submesh("strip", material->id(), INDEX_TYPE_16_BIT, MESH_ARRANGEMENT_TRIANGLE_STRIP);
+    for(auto index: strip_indices) {
+      strip->index_data->index(index);
+    }
+    strip->index_data->done();
+
+    mesh_optimiser::optimise_mesh(mesh);
+
+    assert_equal(strip_indices.size(), strip->index_data->count());
+    for(uint32_t i = 0; i < strip_indices.size(); ++i) {
+      uint32_t index = strip->index_data->at(i);
+      assert_equal(float(strip_indices[i]), mesh->vertex_data->position_at<Vec3>(index)->x);
+    }
+  }
+
+  void test_finalise_keeps_order_and_slots() {
+    auto mesh = application->shared_assets->new_mesh(VertexSpecification::DEFAULT);
+    for(uint32_t i = 0; i < 300; ++i) {
+      mesh->vertex_data->position(float(i), 0.0f, 0.0f);
+      mesh->vertex_data->move_next();
+    }
+    mesh->vertex_data->done();
+
+    auto material = application->shared_assets->new_material();
+    auto outline = application->shared_assets->new_material();
+
+    /* Only "small" narrows, but "large" comes after it and has to move */
+    const std::vector<std::string> names = {"small", "large", "ranged"};
+    auto small = mesh->new_submesh(names[0], material->id(), INDEX_TYPE_16_BIT);
+    for(uint32_t i = 0; i < 9; ++i) {
+      small->index_data->index(i);
+    }
+    small->index_data->done();
+
+    auto large = mesh->new_submesh(names[1], material->id(), INDEX_TYPE_16_BIT);
+    for(uint32_t i = 0; i < 297; ++i) {
+      large->index_data->index(i);
+    }
+    large->index_data->done();
+    large->set_material_at_slot(MATERIAL_SLOT1, outline);
+    large->set_contributes_to_edge_list(false);
+
+    auto ranged = mesh->new_submesh(names[2], material->id());
+    ranged->add_vertex_range(0, 3);
+
+    mesh_optimiser::finalise_mesh(mesh);
+
+    std::vector<std::string> order;
+    for(auto& submesh: mesh->each_submesh()) {
+      order.push_back(submesh->name());
+    }
+    assert_true(order == names);
+
+    assert_equal(INDEX_TYPE_8_BIT, mesh->find_submesh("small")->index_data->index_type());
+
+    large = mesh->find_submesh("large");
+    assert_equal(INDEX_TYPE_16_BIT, large->index_data->index_type());
+    assert_equal(297u, large->index_data->count());
+    assert_equal(outline->id(), large->material_at_slot(MATERIAL_SLOT1)->id());
+    assert_false(large->contributes_to_edge_list());
+
+    ranged = mesh->find_submesh("ranged");
+    assert_equal(1u, ranged->vertex_range_count());
+    assert_equal(3u, ranged->vertex_ranges()[0].count);
+  }
+};
+
+}
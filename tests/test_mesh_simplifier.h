@@ -0,0 +1,80 @@
+#pragma once
+
+#include "simulant/test.h"
+#include "../sources/mesh_simplifier.h"
+
+#include <algorithm>
+#include <set>
+
+namespace {
+
+using namespace smlt;
+
+class MeshSimplifierTestCase : public test::SimulantTestCase {
+public:
+  /* A size x size grid of quads in the XZ plane, facing up */
+  void build_grid(uint32_t size, std::vector<uint32_t>& indices, std::vector<Vec3>& positions) {
+    for(uint32_t y = 0; y <= size; ++y) {
+      for(uint32_t x = 0; x <= size; ++x) {
+        positions.push_back(Vec3(x, 0, y));
+      }
+    }
+
+    for(uint32_t y = 0; y < size; ++y) {
+      for(uint32_t x = 0; x < size; ++x) {
+        uint32_t a = y * (size + 1) + x;
+        uint32_t c = a + size + 1;
+        indices.insert(indices.end(), {a, c, a + 1, a + 1, c, c + 1});
+      }
+    }
+  }
+
+  void test_flat_grid_reaches_target() {
+    std::vector<uint32_t> indices;
+    std::vector<Vec3> positions;
+    build_grid(16, indices, positions);
+
+    float error = 1.0f;
+    auto simplified = mesh_simplifier::simplify(indices, positions, {}, 0, indices.size() / 4, &error);
+
+    assert_true(simplified.size() <= indices.size() / 4);
+    assert_close(0.0f, error, 0.0001f);
+
+    /* Nothing should have been flipped or squashed flat */
+    for(std::size_t i = 0; i < simplified.size(); i += 3) {
+      auto& a = positions[simplified[i]];
+      auto& b = positions[simplified[i + 1]];
+      auto& c = positions[simplified[i + 2]];
+      assert_true((b - a).cross(c - a).y > 0.0f);
+    }
+  }
+
+  void test_borders_are_preserved() {
+    std::vector<uint32_t> indices;
+    std::vector<Vec3> positions;
+    build_grid(8, indices, positions);
+
+    auto simplified = mesh_simplifier::simplify(indices, positions, {}, 0, 0);
+    std::set<uint32_t> used(simplified.begin(), simplified.end());
+
+    assert_true(simplified.size() < indices.size());
+
+    for(uint32_t v = 0; v < positions.size(); ++v) {
+      auto& p = positions[v];
+      if(p.x == 0 || p.x == 8 || p.z == 0 || p.z == 8) {
+        assert_equal(1u, used.count(v));
+      }
+    }
+  }
+
+  void test_target_above_count_is_a_no_op() {
+    std::vector<uint32_t> indices;
+    std::vector<Vec3> positions;
+    build_grid(2, indices, positions);
+
+    auto simplified = mesh_simplifier::simplify(indices, positions, {}, 0, indices.size());
+    assert_true(simplified == indices);
+  }
+};
+
+}
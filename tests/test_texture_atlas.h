@@ -0,0 +1,108 @@
+#pragma once
+
+#include "simulant/test.h"
+#include "../sources/texture_atlas.h"
+
+#include <vector>
+
+namespace {
+
+using namespace smlt;
+
+class TextureAtlasTestCase : public test::SimulantTestCase {
+public:
+  std::vector<uint8_t> solid(uint16_t width, uint16_t height, uint8_t value) {
+    return std::vector<uint8_t>(uint32_t(width) * height * 4, value);
+  }
+
+  const uint8_t* texel(texture_atlas::Atlas& atlas, uint32_t page, uint32_t x, uint32_t y) {
+    return &atlas.page_data(page)[(y * 64 + x) * 4];
+  }
+
+  void test_regions_do_not_overlap() {
+    texture_atlas::Config config;
+    config.page_width = config.page_height = 64;
+    texture_atlas::Atlas atlas(config);
+
+    for(uint32_t i = 0; i < 6; ++i) {
+      auto rgba = solid(16, 8 + i, uint8_t(i + 1));
+      atlas.add("image" + std::to_string(i), 16, 8 + i, &rgba[0]);
+    }
+
+    assert_true(atlas.build());
+    assert_equal(1u, atlas.page_count());
+
+    for(uint32_t i = 0; i < 6; ++i) {
+      auto& region = atlas.region(i);
+      for(uint32_t y = 0; y < region.height; ++y) {
+        for(uint32_t x = 0; x < region.width; ++x) {
+          assert_equal(i + 1, texel(atlas, 0, region.x + x, region.y + y)[0]);
+        }
+      }
+    }
+  }
+
+  void test_gutter_repeats_edges() {
+    texture_atlas::Config config;
+    config.page_width = config.page_height = 64;
+    texture_atlas::Atlas atlas(config);
+
+    std::vector<uint8_t> rgba = solid(2, 2, 0);
+    rgba[0] = 10;   // (0, 0)
+    rgba[12] = 40;  // (1, 1)
+    atlas.add("checker", 2, 2, &rgba[0]);
+    assert_true(atlas.build());
+
+    auto& region = atlas.region(0);
+    assert_equal(10, texel(atlas, 0, region.x - 2, region.y - 2)[0]);
+    assert_equal(40, texel(atlas, 0, region.x + 3, region.y + 3)[0]);
+
+    assert_close(region.x / 64.0f, region.uv_offset.x, 0.0001f);
+    assert_close(2 / 64.0f, region.uv_scale.y, 0.0001f);
+  }
+
+  void test_overflow_starts_a_new_page() {
+    texture_atlas::Config config;
+    config.page_width = config.page_height = 64;
+    texture_atlas::Atlas atlas(config);
+
+    auto rgba = solid(40, 40, 1);
+    atlas.add("first", 40, 40, &rgba[0]);
+    atlas.add("second", 40, 40, &rgba[0]);
+
+    assert_true(atlas.build());
+    assert_equal(2u, atlas.page_count());
+    assert_true(atlas.region(0).page != atlas.region(1).page);
+    assert_equal(1, atlas.find("second"));
+    assert_equal(-1, atlas.find("third"));
+  }
+
+  void test_image_larger_than_a_page() {
+    texture_atlas::Config config;
+    config.page_width = config.page_height = 64;
+    texture_atlas::Atlas atlas(config);
+
+    auto rgba = solid(62, 8, 1);
+
+    /* 62 texels plus a gutter either side doesn't fit */
+    assert_equal(-1, atlas.add("wide", 62, 8, &rgba[0]));
+    assert_equal(-1, atlas.add("tall", 8, 62, &rgba[0]));
+    assert_equal(0, atlas.add("fits", 60, 8, &rgba[0]));
+    assert_true(atlas.build());
+  }
+
+  void test_empty_image_rejected() {
+    texture_atlas::Atlas atlas;
+
+    auto rgba = solid(4, 4, 1);
+    assert_equal(-1, atlas.add("no_width", 0, 4, &rgba[0]));
+    assert_equal(-1, atlas.add("no_height", 4, 0, &rgba[0]));
+    assert_equal(-1, atlas.find("no_width"));
+
+    assert_equal(0, atlas.add("image", 4, 4, &rgba[0]));
+    assert_true(atlas.build());
+    assert_equal(1u, atlas.page_count());
+  }
+};
+
+}
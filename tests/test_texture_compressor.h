@@ -0,0 +1,114 @@
+#pragma once
+
+#include "simulant/test.h"
+#include "../sources/texture_compressor.h"
+
+#include <vector>
+
+namespace {
+
+using namespace smlt;
+
+class TextureCompressorTestCase : public test::SimulantTestCase {
+public:
+  /* Twiddled offset within a square, y in the lowest bit */
+  uint32_t morton(uint32_t x, uint32_t y) {
+    uint32_t offset = 0;
+    for(uint32_t bit = 0; bit < 16; ++bit) {
+      offset |= ((y >> bit) & 1) << (bit * 2);
+      offset |= ((x >> bit) & 1) << (bit * 2 + 1);
+    }
+    return offset;
+  }
+
+  /* Decodes the top level of a square 565 VQ texture back to packed texels */
+  std::vector<uint16_t> decode_565(const std::vector<uint8_t>& data, uint32_t size, uint32_t index_offset) {
+    std::vector<uint16_t> texels(size * size);
+    for(uint32_t y = 0; y < size; ++y) {
+      for(uint32_t x = 0; x < size; ++x) {
+        uint32_t entry = data[index_offset + morton(x / 2, y / 2)];
+        uint32_t texel = entry * 4 + (x % 2) * 2 + (y % 2);
+        texels[y * size + x] = data[texel * 2] | (data[texel * 2 + 1] << 8);
+      }
+    }
+    return texels;
+  }
+
+  /* Four 4x4 squares of flat colour */
+  std::vector<uint8_t> quadrants() {
+    const uint8_t colours[4][4] = {{255, 0, 0, 255}, {0, 255, 0, 255}, {0, 0, 255, 255}, {255, 255, 255, 255}};
+
+    std::vector<uint8_t> rgba;
+    for(uint32_t y = 0; y < 8; ++y) {
+      for(uint32_t x = 0; x < 8; ++x) {
+        const uint8_t* colour = colours[(y / 4) * 2 + (x / 4)];
+        rgba.insert(rgba.end(), colour, colour + 4);
+      }
+    }
+    return rgba;
+  }
+
+  void test_few_blocks_are_exact() {
+    auto rgba = quadrants();
+
+    texture_compressor::Report report;
+    auto data = texture_compressor::compress_vq(&rgba[0], 8, 8, TEXTURE_FORMAT_RGB_1US_565_VQ_TWID, &report);
+
+    assert_equal(2048u + 16u, data.size());
+    assert_equal(16u, report.blocks);
+    assert_equal(4u, report.unique_blocks);
+    assert_close(0.0f, report.rms_error, 0.001f);
+
+    auto texels = decode_565(data, 8, 2048);
+    assert_equal(0xF800, texels[0]);
+    assert_equal(0x07E0, texels[7]);
+    assert_equal(0x001F, texels[7 * 8]);
+    assert_equal(0xFFFF, texels[63]);
+  }
+
+  void test_mipmapped_layout() {
+    std::vector<uint8_t> rgba;
+    for(uint32_t y = 0; y < 64; ++y) {
+      for(uint32_t x = 0; x < 64; ++x) {
+        rgba.insert(rgba.end(), {uint8_t(x * 4), uint8_t(y * 4), uint8_t((x ^ y) * 4), uint8_t(255 - x * 2)});
+      }
+    }
+
+    texture_compressor::Report report;
+    auto data = texture_compressor::compress_vq(&rgba[0], 64, 64, TEXTURE_FORMAT_ARGB_1US_4444_VQ_TWID_MIP, &report);
+
+    /* 1x1 and 2x2 take one index each, then 4x4 up to 64x64 */
+    assert_equal(2048u + 1u + 1u + 4u + 16u + 64u + 256u + 1024u, data.size());
+    assert_equal(uint32_t(data.size()), report.bytes_after);
+    assert_true(report.unique_blocks > texture_compressor::VQ_CODEBOOK_SIZE);
+    assert_true(report.rms_error < 16.0f);
+  }
+
+  void test_invalid_dimensions() {
+    std::vector<uint8_t> rgba(16 * 8 * 4);
+
+    assert_true(texture_compressor::compress_vq(&rgba[0], 12, 8, TEXTURE_FORMAT_RGB_1US_565_VQ_TWID).empty());
+    assert_true(texture_compressor::compress_vq(&rgba[0], 4, 4, TEXTURE_FORMAT_RGB_1US_565_VQ_TWID).empty());
+    assert_true(texture_compressor::compress_vq(&rgba[0], 16, 8, TEXTURE_FORMAT_RGB_1US_565_VQ_TWID_MIP).empty());
+    assert_true(texture_compressor::compress_vq(&rgba[0], 16, 8, TEXTURE_FORMAT_RGB_1US_565).empty());
+    assert_false(texture_compressor::compress_vq(&rgba[0], 16, 8, TEXTURE_FORMAT_RGB_1US_565_VQ_TWID).empty());
+  }
+
+  void test_dtex_header() {
+    std::vector<uint8_t> data(2048 + 16);
+    auto file = texture_compressor::build_dtex(TEXTURE_FORMAT_ARGB_1US_1555_VQ_TWID_MIP, 8, 8, data);
+
+    assert_equal(16u + data.size(), file.size());
+    assert_equal('D', file[0]);
+    assert_equal('X', file[3]);
+    assert_equal(8, file[4]);
+    assert_equal(8, file[6]);
+
+    uint32_t type = file[8] | (file[9] << 8) | (file[10] << 16) | (uint32_t(file[11]) << 24);
+    assert_equal(0xC0000000u, type);
+
+    assert_true(texture_compressor::build_dtex(TEXTURE_FORMAT_RGBA_4UB_8888, 8, 8, data).empty());
+  }
+};
+
+}
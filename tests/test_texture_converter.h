@@ -0,0 +1,146 @@
+#pragma once
+
+#include "simulant/test.h"
+#include "../sources/texture_converter.h"
+
+#include <cmath>
+#include <vector>
+
+namespace {
+
+using namespace smlt;
+
+class TextureConverterTestCase : public test::SimulantTestCase {
+public:
+  std::vector<uint8_t> pattern(uint32_t width, uint32_t height) {
+    std::vector<uint8_t> rgba;
+    for(uint32_t y = 0; y < height; ++y) {
+      for(uint32_t x = 0; x < width; ++x) {
+        rgba.insert(rgba.end(), {uint8_t(x * 13), uint8_t(y * 29), uint8_t(x * y), 255});
+      }
+    }
+    return rgba;
+  }
+
+  void test_twiddled_offset() {
+    assert_equal(0u, texture_converter::twiddled_offset(0, 0, 4, 4));
+    assert_equal(1u, texture_converter::twiddled_offset(0, 1, 4, 4));
+    assert_equal(2u, texture_converter::twiddled_offset(1, 0, 4, 4));
+    assert_equal(3u, texture_converter::twiddled_offset(1, 1, 4, 4));
+    assert_equal(8u, texture_converter::twiddled_offset(2, 0, 4, 4));
+
+    /* Rectangles are a row of twiddled squares */
+    assert_equal(16u, texture_converter::twiddled_offset(4, 0, 8, 4));
+    assert_equal(16u, texture_converter::twiddled_offset(0, 4, 4, 8));
+  }
+
+  void test_twiddle_round_trip() {
+    std::vector<uint16_t> texels(16 * 8);
+    for(uint32_t i = 0; i < texels.size(); ++i) {
+      texels[i] = uint16_t(i * 977);
+    }
+
+    std::vector<uint16_t> twiddled(texels.size());
+    std::vector<uint16_t> untwiddled(texels.size());
+    texture_converter::twiddle(&texels[0], &twiddled[0], 16, 8);
+    texture_converter::untwiddle(&twiddled[0], &untwiddled[0], 16, 8);
+
+    assert_true(twiddled != texels);
+    assert_true(untwiddled == texels);
+  }
+
+  void test_twiddled_pack_matches_twiddle() {
+    auto rgba = pattern(32, 16);
+
+    std::vector<uint16_t> linear(32 * 16);
+    std::vector<uint16_t> expected(32 * 16);
+    std::vector<uint16_t> twiddled(32 * 16);
+
+    assert_true(texture_converter::pack(&rgba[0], 32, 16, TEXTURE_FORMAT_ARGB_1US_4444, false, &linear[0]));
+    assert_true(texture_converter::pack(&rgba[0], 32, 16, TEXTURE_FORMAT_ARGB_1US_4444_TWID, false, &twiddled[0]));
+    texture_converter::twiddle(&linear[0], &expected[0], 32, 16);
+
+    assert_true(twiddled == expected);
+    assert_equal(texture_converter::pack_texel(&rgba[4 * 5], TEXTURE_FORMAT_ARGB_1US_4444), linear[5]);
+  }
+
+  void test_rgba_formats() {
+    const uint8_t texel[4] = {255, 0, 170, 255};
+    uint8_t unpacked[4];
+
+    assert_equal(0xF0AF, texture_converter::pack_texel(texel, TEXTURE_FORMAT_RGBA_1US_4444));
+    texture_converter::unpack_texel(0xF0AF, TEXTURE_FORMAT_RGBA_1US_4444, unpacked);
+    assert_equal(170, unpacked[2]);
+
+    assert_equal(0xF82B, texture_converter::pack_texel(texel, TEXTURE_FORMAT_RGBA_1US_5551));
+    texture_converter::unpack_texel(0xF82B, TEXTURE_FORMAT_RGBA_1US_5551, unpacked);
+    assert_equal(255, unpacked[0]);
+    assert_equal(255, unpacked[3]);
+  }
+
+  void test_dither_keeps_average() {
+    /* 100 falls between two 5-bit levels, so rounding is off by a
+     * constant while dithering averages out close to it */
+    std::vector<uint8_t> rgba;
+    for(uint32_t i = 0; i < 16; ++i) {
+      rgba.insert(rgba.end(), {100, 100, 100, 255});
+    }
+
+    std::vector<uint16_t> rounded(16);
+    std::vector<uint16_t> dithered(16);
+    texture_converter::pack(&rgba[0], 4, 4, TEXTURE_FORMAT_RGB_1US_565, false, &rounded[0]);
+    texture_converter::pack(&rgba[0], 4, 4, TEXTURE_FORMAT_RGB_1US_565, true, &dithered[0]);
+
+    float rounded_red = 0.0f;
+    float dithered_red = 0.0f;
+    for(uint32_t i = 0; i < 16; ++i) {
+      uint8_t texel[4];
+      texture_converter::unpack_texel(rounded[i], TEXTURE_FORMAT_RGB_1US_565, texel);
+      rounded_red += texel[0] / 16.0f;
+      texture_converter::unpack_texel(dithered[i], TEXTURE_FORMAT_RGB_1US_565, texel);
+      dithered_red += texel[0] / 16.0f;
+    }
+
+    assert_true(std::fabs(dithered_red - 100.0f) < std::fabs(rounded_red - 100.0f));
+    assert_close(100.0f, dithered_red, 1.0f);
+  }
+
+  void test_pack_rejects_unsupported() {
+    auto rgba = pattern(12, 8);
+    std::vector<uint16_t> dest(12 * 8);
+
+    assert_false(texture_converter::pack(&rgba[0], 12, 8, TEXTURE_FORMAT_RGB_1US_565_TWID, true, &dest[0]));
+    assert_false(texture_converter::pack(&rgba[0], 12, 8, TEXTURE_FORMAT_RGBA_4UB_8888, true, &dest[0]));
+    assert_true(texture_converter::pack(&rgba[0], 12, 8, TEXTURE_FORMAT_RGB_1US_565, true, &dest[0]));
+  }
+
+  void test_choose_format() {
+    std::vector<uint8_t> opaque(16 * 4, 255);
+    auto cut_out = opaque;
+    cut_out[3] = 0;
+    auto blended = opaque;
+    blended[3] = 128;
+
+    /* Nothing native leaves everything alone */
+    texture_converter::NativeFormats formats;
+    assert_equal(TEXTURE_FORMAT_INVALID, texture_converter::choose_format(formats, &opaque[0], 16));
+
+    formats.rgb565 = true;
+    assert_equal(TEXTURE_FORMAT_RGB_1US_565_TWID, texture_converter::choose_format(formats, &opaque[0], 16));
+    assert_equal(TEXTURE_FORMAT_INVALID, texture_converter::choose_format(formats, &cut_out[0], 16));
+
+    formats.argb1555 = true;
+    assert_equal(TEXTURE_FORMAT_ARGB_1US_1555_TWID, texture_converter::choose_format(formats, &cut_out[0], 16));
+    assert_equal(TEXTURE_FORMAT_INVALID, texture_converter::choose_format(formats, &blended[0], 16));
+
+    formats.argb4444 = true;
+    assert_equal(TEXTURE_FORMAT_ARGB_1US_4444_TWID, texture_converter::choose_format(formats, &blended[0], 16));
+  }
+
+  void test_measure_throughput() {
+    assert_true(texture_converter::measure_throughput(TEXTURE_FORMAT_RGB_1US_565_TWID, true, 64, 64, 2) > 0.0f);
+    assert_equal(0.0f, texture_converter::measure_throughput(TEXTURE_FORMAT_RGBA_4UB_8888, true, 64, 64, 2));
+  }
+};
+
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "simulant/test.h"
+#include "../sources/texture_mipmaps.h"
+
+#include <cmath>
+#include <vector>
+
+namespace {
+
+using namespace smlt;
+
+class TextureMipmapsTestCase : public test::SimulantTestCase {
+public:
+  std::vector<uint8_t> checkerboard(uint32_t width, uint32_t height) {
+    std::vector<uint8_t> rgba;
+    for(uint32_t y = 0; y < height; ++y) {
+      for(uint32_t x = 0; x < width; ++x) {
+        uint8_t value = ((x + y) % 2) ? 255 : 0;
+        rgba.insert(rgba.end(), {value, value, value, 255});
+      }
+    }
+    return rgba;
+  }
+
+  void test_level_count() {
+    assert_equal(9u, texture_mipmaps::level_count(256, 256));
+    assert_equal(4u, texture_mipmaps::level_count(8, 2));
+    assert_equal(1u, texture_mipmaps::level_count(1, 1));
+
+    auto rgba = checkerboard(8, 2);
+    auto levels = texture_mipmaps::build_chain(&rgba[0], 8, 2);
+    assert_equal(4u, levels.size());
+    assert_equal(4, levels[1].width);
+    assert_equal(1, levels[1].height);
+    assert_equal(1, levels[3].width);
+    assert_equal(4u, levels[3].data.size());
+  }
+
+  void test_gamma_correct_average() {
+    /* Half black and half white is half as bright in linear light, which
+     * is 188 in sRGB rather than 128 */
+    auto rgba = checkerboard(2, 2);
+
+    texture_mipmaps::Options options;
+    auto levels = texture_mipmaps::build_chain(&rgba[0], 2, 2, options);
+    assert_close(188, levels[1].data[0], 1);
+
+    options.gamma_correct = false;
+    levels = texture_mipmaps::build_chain(&rgba[0], 2, 2, options);
+    assert_close(128, levels[1].data[0], 1);
+  }
+
+  void test_kaiser_keeps_flat_colour() {
+    std::vector<uint8_t> rgba;
+    for(uint32_t i = 0; i < 16 * 16; ++i) {
+      rgba.insert(rgba.end(), {200, 100, 50, 255});
+    }
+
+    texture_mipmaps::Options options;
+    options.filter = texture_mipmaps::FILTER_KAISER;
+    options.wrap = true;
+    auto levels = texture_mipmaps::build_chain(&rgba[0], 16, 16, options);
+    for(auto& level: levels) {
+      assert_close(200, level.data[0], 1);
+      assert_close(100, level.data[1], 1);
+      assert_close(50, level.data[2], 1);
+      assert_equal(255, level.data[3]);
+    }
+  }
+
+  void test_alpha_coverage_preserved() {
+    /* Thin cut-out blobs, like leaves, which plain filtering thins away */
+    std::vector<uint8_t> rgba;
+    for(uint32_t y = 0; y < 64; ++y) {
+      for(uint32_t x = 0; x < 64; ++x) {
+        uint8_t alpha = (std::sin(x * 0.45f) * std::sin(y * 0.35f) > 0.6f) ? 255 : 0;
+        rgba.insert(rgba.end(), {40, 160, 40, alpha});
+      }
+    }
+
+    float top = texture_mipmaps::alpha_coverage(&rgba[0], 64 * 64, 0.5f);
+
+    texture_mipmaps::Options options;
+    auto preserved = texture_mipmaps::build_chain(&rgba[0], 64, 64, options);
+    options.preserve_alpha_coverage = false;
+    auto plain = texture_mipmaps::build_chain(&rgba[0], 64, 64, options);
+
+    for(uint32_t i = 1; i < 4; ++i) {
+      uint32_t count = preserved[i].width * preserved[i].height;
+      float kept = texture_mipmaps::alpha_coverage(&preserved[i].data[0], count, 0.5f);
+      float lost = texture_mipmaps::alpha_coverage(&plain[i].data[0], count, 0.5f);
+      assert_close(top, kept, 0.05f);
+      assert_true(std::fabs(kept - top) < std::fabs(lost - top));
+    }
+  }
+
+  void test_pack_chain() {
+    auto rgba = checkerboard(16, 8);
+    auto levels = texture_mipmaps::build_chain(&rgba[0], 16, 8);
+
+    auto packed = texture_mipmaps::pack_chain(levels, TEXTURE_FORMAT_RGB_1US_565_TWID);
+    assert_equal(levels.size(), packed.size());
+    assert_equal(16u * 8u * 2u, packed[0].data.size());
+    assert_equal(2u, packed.back().data.size());
+
+    assert_equal(levels.size(), texture_mipmaps::pack_chain(levels, TEXTURE_FORMAT_RGBA_1US_5551).size());
+    assert_true(texture_mipmaps::pack_chain(levels, TEXTURE_FORMAT_RGBA_4UB_8888).empty());
+  }
+
+  void test_level_for_size() {
+    auto rgba = checkerboard(256, 256);
+    auto levels = texture_mipmaps::build_chain(&rgba[0], 256, 256);
+
+    assert_equal(0u, texture_mipmaps::level_for_size(levels, 300.0f));
+    assert_equal(0u, texture_mipmaps::level_for_size(levels, 256.0f));
+    assert_equal(1u, texture_mipmaps::level_for_size(levels, 100.0f));
+    assert_equal(8u, texture_mipmaps::level_for_size(levels, 0.5f));
+  }
+};
+
+}
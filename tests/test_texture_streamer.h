@@ -0,0 +1,179 @@
+#pragma once
+
+#include "simulant/test.h"
+#include "../sources/texture_streamer.h"
+
+#include <memory>
+#include <vector>
+
+namespace {
+
+using namespace smlt;
+
+/* A 2x2 RGBA PNG: top row red, bottom row blue */
+const uint8_t TWO_ROW_PNG[] = {
+  0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A, 0x00, 0x00, 0x00, 0x0D, 0x49, 0x48, 0x44, 0x52,
+  0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x02, 0x08, 0x06, 0x00, 0x00, 0x00, 0x72, 0xB6, 0x0D,
+  0x24, 0x00, 0x00, 0x00, 0x12, 0x49, 0x44, 0x41, 0x54, 0x78, 0xDA, 0x63, 0xF8, 0xCF, 0xC0, 0xF0,
+  0x1F, 0x84, 0x19, 0xA0, 0xF4, 0x7F, 0x00, 0x43, 0xCE, 0x07, 0xF9, 0x00, 0xF3, 0x98, 0x01, 0x00,
+  0x00, 0x00, 0x00, 0x49, 0x45, 0x4E, 0x44, 0xAE, 0x42, 0x60, 0x82
+};
+
+class TextureStreamerTestCase : public test::SimulantTestCase {
+public:
+  std::unique_ptr<texture_streamer::Streamer> streamer(const texture_streamer::Config& config) {
+    return std::unique_ptr<texture_streamer::Streamer>(new texture_streamer::Streamer(
+      application->shared_assets.get(), window->renderer.get(), application->vfs.get(), config
+    ));
+  }
+
+  TexturePtr placeholder() {
+    return application->shared_assets->new_texture(8, 8, TEXTURE_FORMAT_RGBA_4UB_8888);
+  }
+
+  texture_streamer::Decoded solid(uint16_t size) {
+    texture_streamer::Decoded decoded;
+    decoded.width = size;
+    decoded.height = size;
+    decoded.format = TEXTURE_FORMAT_RGBA_4UB_8888;
+    decoded.data.assign(uint32_t(size) * size * 4, 128);
+    return decoded;
+  }
+
+  void test_upload_budget_and_order() {
+    /* Each 16x16 upload is 1024 bytes, so only one fits per frame */
+    texture_streamer::Config config;
+    config.upload_budget = 1500;
+    auto textures = streamer(config);
+
+    auto first = placeholder();
+    auto second = placeholder();
+    auto third = placeholder();
+    textures->submit(second, solid(16));
+    textures->submit(first, solid(16));
+    textures->submit(third, solid(16));
+    assert_equal(3u, textures->pending());
+
+    textures->update();
+    assert_equal(16, second->width());
+    assert_equal(8, first->width());
+    assert_equal(8, third->width());
+
+    textures->update();
+    assert_equal(16, first->width());
+    assert_equal(8, third->width());
+
+    textures->update();
+    assert_equal(16, third->width());
+    assert_equal(0u, textures->pending());
+  }
+
+  void test_upload_over_budget_still_goes() {
+    texture_streamer::Config config;
+    config.upload_budget = 100;
+    auto textures = streamer(config);
+
+    auto texture = placeholder();
+    textures->submit(texture, solid(16));
+    textures->update();
+
+    assert_equal(16, texture->width());
+  }
+
+  void test_request_size_hysteresis() {
+    texture_streamer::Config config;
+    config.stream_base_size = 32;
+    auto textures = streamer(config);
+
+    auto top = solid(64);
+    texture_streamer::Decoded decoded;
+    decoded.width = 64;
+    decoded.height = 64;
+    decoded.format = TEXTURE_FORMAT_RGBA_4UB_8888;
+    decoded.levels = texture_mipmaps::build_chain(&top.data[0], 64, 64);
+
+    auto texture = placeholder();
+    textures->submit(texture, std::move(decoded));
+    textures->update();
+    assert_equal(32, texture->width());
+
+    textures->request_size(texture, 64.0f);
+    textures->update();
+    assert_equal(64, texture->width());
+
+    /* One level down isn't enough to drop back */
+    textures->request_size(texture, 20.0f);
+    textures->update();
+    assert_equal(64, texture->width());
+
+    textures->request_size(texture, 10.0f);
+    textures->update();
+    assert_equal(16, texture->width());
+  }
+
+  void test_release_in_flight() {
+    texture_streamer::Config config;
+    auto textures = streamer(config);
+
+    auto texture = textures->load("simulant/textures/simulant-icon.png");
+    assert_true(bool(texture));
+    assert_equal(1u, textures->pending());
+
+    textures->release(texture);
+    assert_equal(0u, textures->pending());
+
+    for(uint32_t i = 0; i < 20; ++i) {
+      thread::sleep(10);
+      textures->update();
+    }
+
+    assert_equal(config.placeholder_size, texture->width());
+  }
+
+  void test_decode_flips_rows() {
+    auto decoded = texture_streamer::decode(TWO_ROW_PNG, sizeof(TWO_ROW_PNG), texture_streamer::Settings());
+
+    assert_equal(2, decoded.width);
+    assert_equal(2, decoded.height);
+    assert_equal(TEXTURE_FORMAT_RGBA_4UB_8888, decoded.format);
+    assert_equal(16u, decoded.data.size());
+
+    /* Bottom row first, as the texture loader stores it */
+    assert_equal(0, decoded.data[0]);
+    assert_equal(255, decoded.data[2]);
+    assert_equal(255, decoded.data[8]);
+    assert_equal(0, decoded.data[10]);
+  }
+
+  void test_decode_flip_vertically() {
+    texture_streamer::Settings settings;
+    settings.flip_vertically = true;
+    auto decoded = texture_streamer::decode(TWO_ROW_PNG, sizeof(TWO_ROW_PNG), settings);
+
+    /* Top row first */
+    assert_equal(255, decoded.data[0]);
+    assert_equal(0, decoded.data[2]);
+    assert_equal(0, decoded.data[8]);
+    assert_equal(255, decoded.data[10]);
+  }
+
+  void test_load_applies_flags() {
+    texture_streamer::Config config;
+    auto textures = streamer(config);
+
+    TextureFlags flags;
+    flags.free_data = TEXTURE_FREE_DATA_NEVER;
+    flags.auto_upload = false;
+    flags.filter = TEXTURE_FILTER_BILINEAR;
+
+    auto texture = textures->load("simulant/textures/simulant-icon.png", flags);
+    assert_true(bool(texture));
+    assert_equal(TEXTURE_FREE_DATA_NEVER, texture->free_data_mode());
+    assert_false(texture->auto_upload());
+    assert_equal(TEXTURE_FILTER_BILINEAR, texture->texture_filter());
+
+    textures->release(texture);
+  }
+};
+
+}